@@ -14,11 +14,17 @@ class Acceptor : noncopyable
 public:
   using NewConnectionCallback = std::function<void(int sockfd, const InetAddress &)>;
   Acceptor(EventLoop *loop, const InetAddress &listenAddr, bool reuseport);
+  // 接管一个已经bind(可能已经listen)的socket，例如不停机重启时从旧进程继承来的
+  Acceptor(EventLoop *loop, int listenFd);
   ~Acceptor();
 
   void setNewConnectionCallback(const NewConnectionCallback &cb) { newConnectionCallback_ = cb; }
   bool listenning() const { return listenning_; }
   void listen();
+  // 不再accept新连接，监听socket保持打开，已在队列里的连接留给接手的进程
+  void stopAccepting();
+
+  int fd() const { return acceptSocket_.fd(); }
 
 private:
   void handleRead();
@@ -1,6 +1,7 @@
 #include "Acceptor.h"
 #include "Logger.h"
 #include "InetAddress.h"
+#include "Probes.h"
 
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -29,6 +30,15 @@ Acceptor::Acceptor(EventLoop *loop, const InetAddress &listenAddr, bool reusepor
   accpetChannel_.setReadCallback(std::bind(&Acceptor::handleRead, this));
 }
 
+Acceptor::Acceptor(EventLoop *loop, int listenFd)
+    : loop_(loop),
+      acceptSocket_(listenFd),
+      accpetChannel_(loop, acceptSocket_.fd()),
+      listenning_(false)
+{
+  accpetChannel_.setReadCallback(std::bind(&Acceptor::handleRead, this));
+}
+
 Acceptor::~Acceptor()
 {
   accpetChannel_.disableAll();
@@ -42,6 +52,12 @@ void Acceptor::listen()
   accpetChannel_.enableReading(); // accpetChannel_注册到poller里面,让poller监听是否有事件发生
 }
 
+void Acceptor::stopAccepting()
+{
+  listenning_ = false;
+  accpetChannel_.disableAll();
+}
+
 // listenfd有事件发生了，有新用户连接了
 void Acceptor::handleRead()
 {
@@ -49,6 +65,7 @@ void Acceptor::handleRead()
   int connfd = acceptSocket_.accept(&peerAddr);
   if (connfd >= 0)
   {
+    MYMUDUO_PROBE2(accept, connfd, acceptSocket_.fd());
     if (newConnectionCallback_)
     {
       newConnectionCallback_(connfd, peerAddr); // Tcp的回调，轮询找到subloop，唤醒分发新客户端的Channel（包含connfd）
@@ -0,0 +1,255 @@
+#include "AsyncLogging.h"
+#include "LogFile.h"
+
+#include <chrono>
+#include <string.h>
+#include <stdio.h>
+
+namespace
+{
+  std::atomic<uint64_t> nextId(1);
+
+  // 当前线程在哪个AsyncLogging里登记的前端缓冲区
+  __thread uint64_t t_owner = 0;
+  __thread void *t_buffer = nullptr;
+
+  // 线程退出时析构，标记该线程的前端缓冲区不会再有人写
+  struct ThreadExitHook
+  {
+    ~ThreadExitHook()
+    {
+      if (exited)
+      {
+        exited->store(true, std::memory_order_release);
+      }
+    }
+    std::shared_ptr<std::atomic_bool> exited;
+  };
+  thread_local ThreadExitHook t_exitHook;
+}
+
+AsyncLogging::AsyncLogging(const std::string &basename,
+                           off_t rollSize,
+                           int flushInterval,
+                           size_t maxPendingBuffers,
+                           OverflowPolicy policy)
+    : flushInterval_(flushInterval > 0 ? flushInterval : 3),
+      maxPendingBuffers_(maxPendingBuffers > 0 ? maxPendingBuffers : 1),
+      policy_(policy),
+      basename_(basename),
+      rollSize_(rollSize),
+      id_(nextId++),
+      running_(false),
+      dropped_(0),
+      thread_(std::bind(&AsyncLogging::threadFunc, this), "AsyncLogging")
+{
+}
+
+AsyncLogging::~AsyncLogging()
+{
+  if (running_)
+  {
+    stop();
+  }
+}
+
+void AsyncLogging::start()
+{
+  running_ = true;
+  thread_.start();
+}
+
+void AsyncLogging::stop()
+{
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    running_ = false;
+  }
+  cond_.notify_one();
+  notFull_.notify_all();
+  thread_.join();
+}
+
+AsyncLogging::ThreadBuffer *AsyncLogging::threadBuffer()
+{
+  if (t_owner != id_)
+  {
+    std::unique_ptr<ThreadBuffer> tb(new ThreadBuffer);
+    if (t_exitHook.exited)
+    {
+      t_exitHook.exited->store(true, std::memory_order_release); // 原来登记的缓冲区这个线程不再写了
+    }
+    t_exitHook.exited = tb->exited;
+    std::unique_lock<std::mutex> lock(mutex_);
+    t_buffer = tb.get();
+    t_owner = id_;
+    threadBuffers_.push_back(std::move(tb));
+  }
+  return static_cast<ThreadBuffer *>(t_buffer);
+}
+
+AsyncLogging::BufferPtr AsyncLogging::newBuffer()
+{
+  if (spare_.empty())
+  {
+    return BufferPtr(new LogBuffer);
+  }
+  BufferPtr buffer = std::move(spare_.back());
+  spare_.pop_back();
+  buffer->len = 0;
+  buffer->lines = 0;
+  return buffer;
+}
+
+void AsyncLogging::append(const char *logline, size_t len)
+{
+  if (!running_.load(std::memory_order_relaxed) || len > kBufferSize)
+  {
+    return;
+  }
+
+  ThreadBuffer *tb = threadBuffer();
+  // 这把锁只有后台线程偶尔try_lock，写日志线程之间不竞争
+  std::unique_lock<std::mutex> tbLock(tb->mutex);
+  if (tb->current && tb->current->avail() < len)
+  {
+    BufferPtr full = std::move(tb->current);
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (policy_ == kBlock)
+    {
+      notFull_.wait(lock, [this]() { return pending_.size() < maxPendingBuffers_ || !running_; });
+    }
+    if (pending_.size() < maxPendingBuffers_)
+    {
+      pending_.push_back(std::move(full));
+      cond_.notify_one();
+    }
+    else
+    {
+      // 后台线程跟不上，丢掉这一整块，避免日志拖慢loop线程
+      dropped_.fetch_add(full->lines, std::memory_order_relaxed);
+      spare_.push_back(std::move(full));
+    }
+    tb->current = newBuffer();
+  }
+  else if (!tb->current)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    tb->current = newBuffer();
+  }
+
+  LogBuffer *buffer = tb->current.get();
+  memcpy(buffer->data + buffer->len, logline, len);
+  buffer->len += len;
+  ++buffer->lines;
+}
+
+void AsyncLogging::threadFunc()
+{
+  LogFile output(basename_, rollSize_);
+  std::vector<BufferPtr> toWrite;
+  std::vector<ThreadBuffer *> threads;
+  std::vector<ThreadBuffer *> exited;
+  uint64_t reported = 0;
+  auto lastSweep = std::chrono::steady_clock::now();
+  const auto interval = std::chrono::seconds(flushInterval_);
+
+  bool stopping = false;
+  while (!stopping)
+  {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (pending_.empty() && running_)
+      {
+        cond_.wait_for(lock, interval);
+      }
+      stopping = !running_;
+      toWrite.swap(pending_);
+      threads.clear();
+      for (auto &tb : threadBuffers_)
+      {
+        threads.push_back(tb.get());
+      }
+    }
+    notFull_.notify_all();
+
+    // 每隔flushInterval秒把各线程没写满的缓冲区也收走，保证日志的最大延迟；停止时全部收走
+    auto now = std::chrono::steady_clock::now();
+    if (stopping || now - lastSweep >= interval)
+    {
+      lastSweep = now;
+      for (ThreadBuffer *tb : threads)
+      {
+        std::unique_lock<std::mutex> tbLock(tb->mutex, std::defer_lock);
+        if (stopping)
+        {
+          tbLock.lock();
+        }
+        else if (!tbLock.try_lock())
+        {
+          continue; // 该线程正在写，下一轮再收
+        }
+        if (tb->current && tb->current->len > 0)
+        {
+          toWrite.push_back(std::move(tb->current));
+        }
+        if (tb->exited->load(std::memory_order_acquire))
+        {
+          exited.push_back(tb);
+        }
+      }
+      if (!exited.empty())
+      {
+        // 线程已经退出，剩下的日志刚才收走了，回收它的前端缓冲区
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (ThreadBuffer *tb : exited)
+        {
+          for (auto it = threadBuffers_.begin(); it != threadBuffers_.end(); ++it)
+          {
+            if (it->get() == tb)
+            {
+              threadBuffers_.erase(it);
+              break;
+            }
+          }
+        }
+        exited.clear();
+      }
+      if (stopping)
+      {
+        // 收缓冲区之前可能又有线程交上来写满的块
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (BufferPtr &buffer : pending_)
+        {
+          toWrite.push_back(std::move(buffer));
+        }
+        pending_.clear();
+      }
+    }
+
+    uint64_t dropped = dropped_.load(std::memory_order_relaxed);
+    if (dropped != reported)
+    {
+      char msg[128];
+      int n = snprintf(msg, sizeof msg, "AsyncLogging dropped %llu log lines\n",
+                       static_cast<unsigned long long>(dropped - reported));
+      output.append(msg, n);
+      reported = dropped;
+    }
+    for (const BufferPtr &buffer : toWrite)
+    {
+      output.append(buffer->data, buffer->len);
+    }
+    output.flush();
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (BufferPtr &buffer : toWrite)
+    {
+      if (spare_.size() < maxPendingBuffers_)
+      {
+        spare_.push_back(std::move(buffer));
+      }
+    }
+    toWrite.clear();
+  }
+}
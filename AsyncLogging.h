@@ -0,0 +1,89 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Thread.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+/**
+ * 异步日志后端：每个写日志的线程有自己的前端缓冲区，只在缓冲区写满时才碰一次全局锁，
+ * 后台线程批量把写满的缓冲区写到LogFile，并每隔flushInterval秒把各线程未写满的缓冲区也收走。
+ * 待写的缓冲区超过maxPendingBuffers个时按策略丢弃日志或阻塞写日志的线程。
+ * 用法: Logger::instance().setOutput(std::bind(&AsyncLogging::append, &log, _1, _2));
+ */
+class AsyncLogging : noncopyable
+{
+public:
+  enum OverflowPolicy
+  {
+    kDrop,  // 丢弃并计数，不影响loop线程延迟
+    kBlock, // 等后台线程写完，不丢日志
+  };
+
+  AsyncLogging(const std::string &basename,
+               off_t rollSize,
+               int flushInterval = 3,
+               size_t maxPendingBuffers = 16,
+               OverflowPolicy policy = kDrop);
+  ~AsyncLogging();
+
+  void append(const char *logline, size_t len);
+
+  void start();
+  // start与stop之间append的日志才会输出
+  // stop写完所有已提交的日志后返回
+  void stop();
+
+  uint64_t droppedLines() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+  static const size_t kBufferSize = 256 * 1024;
+
+  struct LogBuffer
+  {
+    LogBuffer() : len(0), lines(0) {}
+    size_t avail() const { return sizeof data - len; }
+    char data[kBufferSize];
+    size_t len;
+    size_t lines;
+  };
+  using BufferPtr = std::unique_ptr<LogBuffer>;
+
+  // 每个写日志线程一个，mutex只和后台线程偶尔竞争
+  // 线程退出(或改用别的AsyncLogging)时exited置位，后台线程收走剩下的日志后回收
+  struct ThreadBuffer
+  {
+    ThreadBuffer() : exited(std::make_shared<std::atomic_bool>(false)) {}
+    std::mutex mutex;
+    BufferPtr current;
+    std::shared_ptr<std::atomic_bool> exited; // 线程局部的退出钩子也持有一份，不依赖AsyncLogging还活着
+  };
+
+  ThreadBuffer *threadBuffer();
+  BufferPtr newBuffer(); // 调用时持有mutex_
+  void threadFunc();
+
+  const int flushInterval_;
+  const size_t maxPendingBuffers_;
+  const OverflowPolicy policy_;
+  const std::string basename_;
+  const off_t rollSize_;
+  const uint64_t id_; // 区分线程局部缓存属于哪个AsyncLogging
+
+  std::atomic_bool running_;
+  std::atomic<uint64_t> dropped_;
+  Thread thread_;
+
+  std::mutex mutex_; // 保护下面的成员
+  std::condition_variable cond_;    // 通知后台线程有写满的缓冲区
+  std::condition_variable notFull_; // kBlock策略下通知前端有空位
+  std::vector<BufferPtr> pending_;  // 写满待落盘的缓冲区
+  std::vector<BufferPtr> spare_;    // 落盘后回收的缓冲区
+  std::vector<std::unique_ptr<ThreadBuffer>> threadBuffers_;
+};
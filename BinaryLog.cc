@@ -0,0 +1,503 @@
+#include "BinaryLog.h"
+#include "Logger.h"
+#include "Thread.h"
+#include "Timestamp.h"
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+namespace
+{
+  using BinaryLog::detail::Ring;
+  using BinaryLog::detail::kRingSize;
+  const uint32_t kWrapMarker = 0xffffffff;
+
+  struct Format
+  {
+    struct Spec
+    {
+      std::string spec;    // 例如"%-5d"
+      char conversion;     // 例如'd'
+      std::string literal; // spec后面直到下一个spec的普通文本
+    };
+    int level;
+    std::string prefix;
+    std::vector<Spec> specs;
+  };
+
+  struct State
+  {
+    State() : dropped(0)
+    {
+      anchorTicks = BinaryLog::detail::ticks();
+      anchorNs = realtimeNs();
+    }
+
+    static int64_t realtimeNs()
+    {
+      timespec ts;
+      clock_gettime(CLOCK_REALTIME, &ts);
+      return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    }
+
+    std::atomic<uint64_t> dropped;
+    int64_t anchorTicks;
+    int64_t anchorNs;
+    std::unique_ptr<Thread> thread;
+
+    std::mutex mutex; // 保护formats、rings和freeRings
+    std::deque<Format> formats;
+    std::vector<std::unique_ptr<Ring>> rings;     // 线程退出后它的环先留着，由后台线程读完再挪到freeRings
+    std::vector<std::unique_ptr<Ring>> freeRings; // 读完的空环，新线程优先复用，省掉分配和预先缺页
+  };
+
+  // 最多留几个空环给后面的线程复用，多的直接释放
+  const size_t kMaxFreeRings = 4;
+
+  State &state()
+  {
+    static State s;
+    return s;
+  }
+
+  // 同步模式(后台线程没运行)下reserve给出的临时区
+  __thread char *t_scratch = nullptr;
+  __thread size_t t_scratchSize = 0;
+  // 线程退出钩子已经析构，之后这个线程的日志不再分配环
+  __thread bool t_exited = false;
+
+  // 线程退出时析构，把这个线程的环标记为可回收
+  struct ThreadExitHook
+  {
+    ThreadExitHook() : ring(nullptr) {}
+    ~ThreadExitHook()
+    {
+      t_exited = true;
+      BinaryLog::detail::t_ring = nullptr;
+      if (ring != nullptr)
+      {
+        ring->exited.store(true, std::memory_order_release);
+      }
+    }
+    Ring *ring;
+  };
+  thread_local ThreadExitHook t_exitHook;
+
+  void parseFormat(const char *fmt, Format *format)
+  {
+    std::string *literal = &format->prefix;
+    for (const char *p = fmt; *p != '\0'; ++p)
+    {
+      if (*p != '%')
+      {
+        literal->push_back(*p);
+        continue;
+      }
+      if (p[1] == '%')
+      {
+        literal->push_back('%');
+        ++p;
+        continue;
+      }
+      const char *start = p++;
+      while (*p != '\0' && strchr("diouxXeEfFgGaAcsp", *p) == nullptr)
+      {
+        ++p;
+      }
+      if (*p == '\0')
+      {
+        literal->append(start);
+        break;
+      }
+      Format::Spec spec;
+      spec.spec.assign(start, p + 1);
+      spec.conversion = *p;
+      format->specs.push_back(spec);
+      literal = &format->specs.back().literal;
+    }
+  }
+
+  template <typename T>
+  void appendFormatted(std::string *out, const std::string &spec, T value)
+  {
+    char buf[256];
+    int n = snprintf(buf, sizeof buf, spec.c_str(), value);
+    if (n < 0)
+    {
+      return;
+    }
+    if (static_cast<size_t>(n) < sizeof buf)
+    {
+      out->append(buf, n);
+      return;
+    }
+    std::string big(n + 1, '\0');
+    snprintf(&big[0], big.size(), spec.c_str(), value);
+    out->append(big.data(), n);
+  }
+
+  // 把一条记录格式化成和Logger::log相同格式的一行并输出
+  void decodeEntry(const char *entry, int64_t ns)
+  {
+    BinaryLog::EntryHeader header;
+    memcpy(&header, entry, sizeof header);
+    const Format *format;
+    {
+      std::unique_lock<std::mutex> lock(state().mutex);
+      if (header.fmtId >= state().formats.size())
+      {
+        return;
+      }
+      format = &state().formats[header.fmtId];
+    }
+
+    std::string line;
+    switch (format->level)
+    {
+    case INFO:
+      line = "[INFO]";
+      break;
+    case ERROR:
+      line = "[ERROR]";
+      break;
+    case FATAL:
+      line = "[FATAL]";
+      break;
+    case DEBUG:
+      line = "[DEBUG]";
+      break;
+    default:
+      break;
+    }
+    line += Timestamp(ns / 1000).toFormattedString();
+    line += ":";
+    line += format->prefix;
+
+    const char *p = entry + sizeof header;
+    const char *end = entry + header.len;
+    for (const Format::Spec &spec : format->specs)
+    {
+      if (p >= end)
+      {
+        break;
+      }
+      uint8_t type = static_cast<uint8_t>(*p++);
+      char c = spec.conversion;
+      bool isFloat = strchr("eEfFgGaA", c) != nullptr;
+      bool isInteger = !isFloat && c != 's' && c != 'p';
+      // 类型和格式对不上时不交给snprintf，避免把整数当字符串指针解引用
+      bool matched = false;
+      if (type == BinaryLog::kString)
+      {
+        uint32_t len;
+        memcpy(&len, p, sizeof len);
+        std::string s(p + sizeof len, len);
+        p += sizeof len + len;
+        if ((matched = c == 's'))
+        {
+          appendFormatted(&line, spec.spec, s.c_str());
+        }
+      }
+      else if (type == BinaryLog::kDouble)
+      {
+        double v;
+        memcpy(&v, p, sizeof v);
+        p += sizeof v;
+        if ((matched = isFloat))
+        {
+          appendFormatted(&line, spec.spec, v);
+        }
+      }
+      else if (type == BinaryLog::kPointer)
+      {
+        const void *v;
+        memcpy(&v, p, sizeof v);
+        p += sizeof v;
+        if ((matched = c == 'p'))
+        {
+          appendFormatted(&line, spec.spec, v);
+        }
+      }
+      else if (type == BinaryLog::kInt64)
+      {
+        int64_t v;
+        memcpy(&v, p, sizeof v);
+        p += sizeof v;
+        if ((matched = isInteger))
+        {
+          appendFormatted(&line, spec.spec, static_cast<long long>(v));
+        }
+      }
+      else
+      {
+        int32_t v;
+        memcpy(&v, p, sizeof v);
+        p += sizeof v;
+        if ((matched = isInteger))
+        {
+          appendFormatted(&line, spec.spec, static_cast<int>(v));
+        }
+      }
+      if (!matched)
+      {
+        line += "<?>";
+      }
+      line += spec.literal;
+    }
+    line += "\n";
+    Logger::instance().append(line.data(), line.size());
+  }
+
+  // 读完一个环里已发布的记录，返回是否读到
+  bool drainRing(Ring *ring, int64_t anchorTicks, int64_t anchorNs, double nsPerTick)
+  {
+    char *buffer = ring->buffer.get();
+    size_t r = ring->readPos.load(std::memory_order_relaxed);
+    size_t w = ring->writePos.load(std::memory_order_acquire);
+    if (r == w)
+    {
+      return false;
+    }
+    while (r != w)
+    {
+      uint32_t fmtId = kWrapMarker;
+      if (kRingSize - r >= sizeof(BinaryLog::EntryHeader))
+      {
+        memcpy(&fmtId, buffer + r, sizeof fmtId);
+      }
+      if (fmtId == kWrapMarker)
+      {
+        r = 0;
+        continue;
+      }
+      BinaryLog::EntryHeader header;
+      memcpy(&header, buffer + r, sizeof header);
+      decodeEntry(buffer + r, anchorNs + static_cast<int64_t>((header.ticks - anchorTicks) * nsPerTick));
+      r += header.len;
+    }
+    ring->readPos.store(r, std::memory_order_release);
+    return true;
+  }
+
+  double calibrate(State &s)
+  {
+#if defined(__x86_64__) || defined(__i386__)
+    // 用启动以来tsc和墙上时间的比值换算，间隔太短时先等一会儿
+    int64_t ns = State::realtimeNs();
+    while (ns - s.anchorNs < 1000000)
+    {
+      ::usleep(1000);
+      ns = State::realtimeNs();
+    }
+    int64_t ticks = BinaryLog::detail::ticks();
+    return static_cast<double>(ns - s.anchorNs) / static_cast<double>(ticks - s.anchorTicks);
+#else
+    return 1.0;
+#endif
+  }
+
+  // 把读完的、所属线程已退出的环从rings挪到freeRings
+  void recycleRings(State &s, const std::vector<Ring *> &exited)
+  {
+    std::unique_lock<std::mutex> lock(s.mutex);
+    for (Ring *ring : exited)
+    {
+      for (auto it = s.rings.begin(); it != s.rings.end(); ++it)
+      {
+        if (it->get() != ring)
+        {
+          continue;
+        }
+        if (s.freeRings.size() < kMaxFreeRings)
+        {
+          s.freeRings.push_back(std::move(*it));
+        }
+        s.rings.erase(it);
+        break;
+      }
+    }
+  }
+
+  void drainAll(State &s)
+  {
+    std::vector<Ring *> rings;
+    {
+      std::unique_lock<std::mutex> lock(s.mutex);
+      for (auto &ring : s.rings)
+      {
+        rings.push_back(ring.get());
+      }
+    }
+    double nsPerTick = calibrate(s);
+    bool any = false;
+    std::vector<Ring *> exited;
+    for (Ring *ring : rings)
+    {
+      // 先看退出标志再读，标志置位前写的记录这一次一定能读到
+      bool done = ring->exited.load(std::memory_order_acquire);
+      any = drainRing(ring, s.anchorTicks, s.anchorNs, nsPerTick) || any;
+      if (done)
+      {
+        exited.push_back(ring);
+      }
+    }
+    if (!exited.empty())
+    {
+      recycleRings(s, exited);
+    }
+    if (!any && BinaryLog::detail::g_running)
+    {
+      ::usleep(1000); // 日志线程不通知后台线程，空闲时轮询
+    }
+  }
+
+  void threadFunc()
+  {
+    State &s = state();
+    while (BinaryLog::detail::g_running)
+    {
+      drainAll(s);
+    }
+    drainAll(s);
+    Logger::instance().flush();
+  }
+}
+
+namespace BinaryLog
+{
+  int registerFormat(int level, const char *fmt)
+  {
+    Format format;
+    format.level = level;
+    parseFormat(fmt, &format);
+    std::unique_lock<std::mutex> lock(state().mutex);
+    state().formats.push_back(std::move(format));
+    return static_cast<int>(state().formats.size() - 1);
+  }
+
+  void start()
+  {
+    State &s = state();
+    if (detail::g_running)
+    {
+      return;
+    }
+    detail::g_running = true;
+    s.thread.reset(new Thread(threadFunc, "BinaryLog"));
+    s.thread->start();
+  }
+
+  void stop()
+  {
+    State &s = state();
+    if (!detail::g_running)
+    {
+      return;
+    }
+    detail::g_running = false;
+    s.thread->join();
+    s.thread.reset();
+  }
+
+  uint64_t droppedLines()
+  {
+    return state().dropped.load(std::memory_order_relaxed);
+  }
+
+  namespace detail
+  {
+    std::atomic_bool g_running(false);
+    __thread Ring *t_ring = nullptr;
+
+    Ring::Ring() : buffer(new char[kRingSize]), writePos(0), cachedReadPos(0), readPos(0), exited(false)
+    {
+      memset(buffer.get(), 0, kRingSize); // 先把页面都映射上，热路径上不再缺页
+    }
+
+    char *reserveSlow(size_t n)
+    {
+      State &s = state();
+      if (!g_running.load(std::memory_order_relaxed) || t_exited)
+      {
+        if (t_scratchSize < n)
+        {
+          t_scratch = static_cast<char *>(::realloc(t_scratch, n));
+          t_scratchSize = n;
+        }
+        return t_scratch;
+      }
+
+      Ring *ring = t_ring;
+      if (ring == nullptr)
+      {
+        std::unique_ptr<Ring> newRing;
+        {
+          std::unique_lock<std::mutex> lock(s.mutex);
+          if (!s.freeRings.empty())
+          {
+            newRing = std::move(s.freeRings.back());
+            s.freeRings.pop_back();
+          }
+        }
+        if (newRing)
+        {
+          // 后台线程已经读完，读写位置相等，只需清掉退出标志
+          newRing->cachedReadPos = newRing->readPos.load(std::memory_order_relaxed);
+          newRing->exited.store(false, std::memory_order_relaxed);
+        }
+        else
+        {
+          newRing.reset(new Ring);
+        }
+        ring = newRing.get();
+        t_exitHook.ring = ring; // 第一次访问时登记线程退出时的析构
+        std::unique_lock<std::mutex> lock(s.mutex);
+        s.rings.push_back(std::move(newRing));
+        t_ring = ring;
+      }
+
+      // 读写位置相等表示空，所以写入后不能追上readPos
+      size_t w = ring->writePos.load(std::memory_order_relaxed);
+      for (int attempt = 0; attempt < 2; ++attempt)
+      {
+        size_t r = ring->cachedReadPos;
+        if (w >= r)
+        {
+          if (kRingSize - w > n || (kRingSize - w == n && r != 0))
+          {
+            return ring->buffer.get() + w;
+          }
+          if (r > n)
+          {
+            // 尾部放不下，写回绕标记后从头开始
+            if (kRingSize - w >= sizeof(EntryHeader))
+            {
+              memcpy(ring->buffer.get() + w, &kWrapMarker, sizeof kWrapMarker);
+            }
+            ring->writePos.store(0, std::memory_order_release);
+            return ring->buffer.get();
+          }
+        }
+        else if (r - w > n)
+        {
+          return ring->buffer.get() + w;
+        }
+        ring->cachedReadPos = ring->readPos.load(std::memory_order_acquire);
+      }
+      s.dropped.fetch_add(1, std::memory_order_relaxed);
+      return nullptr;
+    }
+
+    void commitSlow(char *entry, size_t)
+    {
+      decodeEntry(entry, State::realtimeNs());
+    }
+  }
+}
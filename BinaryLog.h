@@ -0,0 +1,191 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <type_traits>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * NanoLog风格的二进制日志：格式串在每条日志语句第一次执行时登记一次换成id，
+ * 热路径只把id、时间戳(x86上是rdtsc)和原始参数拷进当前线程的环形缓冲区，
+ * 由后台线程按格式串格式化后交给Logger的输出（可以再接AsyncLogging）。
+ * 编译时定义MYMUDUO_BINARY_LOG后LOG_INFO/LOG_ERROR/LOG_DEBUG走这条路径。
+ *
+ * 参数支持整数、浮点、指针和C字符串(%s拷贝字符串内容)，不支持'*'宽度/精度。
+ * 环形缓冲区满时丢弃日志并计数，从不阻塞调用线程；start之前和stop之后的日志在调用线程同步格式化输出。
+ */
+namespace BinaryLog
+{
+  enum ArgType : uint8_t
+  {
+    kInt,
+    kInt64,
+    kDouble,
+    kPointer,
+    kString,
+  };
+
+  struct EntryHeader
+  {
+    uint32_t fmtId;
+    uint32_t len; // 含头部的总字节数
+    int64_t ticks;
+  };
+
+  // 返回格式串的id，线程安全
+  int registerFormat(int level, const char *fmt);
+
+  void start();
+  // 格式化完所有线程已提交的日志后返回
+  void stop();
+  uint64_t droppedLines();
+
+  namespace detail
+  {
+    const size_t kRingSize = 1024 * 1024;
+
+    // 单生产者单消费者的字节环：日志线程写，后台线程读。一条记录不跨越环尾，放不下时写一个回绕标记从头开始
+    struct Ring
+    {
+      Ring();
+
+      std::unique_ptr<char[]> buffer;
+      std::atomic<size_t> writePos; // 生产者发布
+      size_t cachedReadPos;         // 生产者缓存的readPos，空间不够时才重新读
+      std::atomic<size_t> readPos;  // 消费者发布
+      std::atomic_bool exited;      // 所属线程已退出，后台线程读完后回收
+    };
+
+    extern std::atomic_bool g_running;
+    // initial-exec模型：动态库里的线程局部变量访问不必调__tls_get_addr
+    extern __thread __attribute__((tls_model("initial-exec"))) Ring *t_ring;
+
+    char *reserveSlow(size_t n);
+    void commitSlow(char *entry, size_t n);
+
+    // 在当前线程的环形缓冲区里预留n字节，写不下时返回nullptr；常见情况内联，不出函数调用
+    inline char *reserve(size_t n)
+    {
+      Ring *ring = t_ring;
+      if (ring != nullptr && g_running.load(std::memory_order_relaxed))
+      {
+        size_t w = ring->writePos.load(std::memory_order_relaxed);
+        if (w >= ring->cachedReadPos && kRingSize - w > n)
+        {
+          return ring->buffer.get() + w;
+        }
+      }
+      return reserveSlow(n);
+    }
+
+    inline void commit(char *entry, size_t n)
+    {
+      Ring *ring = t_ring;
+      char *base = ring != nullptr ? ring->buffer.get() : nullptr;
+      if (base == nullptr || entry < base || entry >= base + kRingSize)
+      {
+        commitSlow(entry, n); // 同步模式的临时区
+        return;
+      }
+      size_t w = static_cast<size_t>(entry - base) + n;
+      ring->writePos.store(w == kRingSize ? 0 : w, std::memory_order_release);
+    }
+
+    inline int64_t ticks()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+      return static_cast<int64_t>(__builtin_ia32_rdtsc());
+#else
+      timespec ts;
+      clock_gettime(CLOCK_REALTIME, &ts);
+      return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+#endif
+    }
+
+    inline size_t argSize() { return 0; }
+    inline size_t argSize(const char *s) { return 1 + sizeof(uint32_t) + strlen(s); }
+    inline size_t argSize(char *s) { return argSize(static_cast<const char *>(s)); }
+    template <typename T>
+    inline size_t argSize(T *) { return 1 + sizeof(void *); }
+    template <typename T>
+    inline typename std::enable_if<std::is_arithmetic<T>::value || std::is_enum<T>::value, size_t>::type
+    argSize(T)
+    {
+      return 1 + (std::is_floating_point<T>::value ? sizeof(double) : (sizeof(T) <= 4 ? 4 : 8));
+    }
+    // 至少两个参数时才拆分，单个参数一定落到上面的重载
+    template <typename T, typename U, typename... Rest>
+    inline size_t argSize(T first, U second, Rest... rest) { return argSize(first) + argSize(second, rest...); }
+
+    inline void encode(char *&) {}
+    inline void encode(char *&p, const char *s)
+    {
+      uint32_t len = static_cast<uint32_t>(strlen(s));
+      *p++ = kString;
+      memcpy(p, &len, sizeof len);
+      memcpy(p + sizeof len, s, len);
+      p += sizeof len + len;
+    }
+    inline void encode(char *&p, char *s) { encode(p, static_cast<const char *>(s)); }
+    template <typename T>
+    inline void encode(char *&p, T *ptr)
+    {
+      const void *v = ptr;
+      *p++ = kPointer;
+      memcpy(p, &v, sizeof v);
+      p += sizeof v;
+    }
+    template <typename T>
+    inline typename std::enable_if<std::is_arithmetic<T>::value || std::is_enum<T>::value>::type
+    encode(char *&p, T value)
+    {
+      if (std::is_floating_point<T>::value)
+      {
+        double v = static_cast<double>(value);
+        *p++ = kDouble;
+        memcpy(p, &v, sizeof v);
+        p += sizeof v;
+      }
+      else if (sizeof(T) <= 4)
+      {
+        int32_t v = static_cast<int32_t>(value);
+        *p++ = kInt;
+        memcpy(p, &v, sizeof v);
+        p += sizeof v;
+      }
+      else
+      {
+        int64_t v = static_cast<int64_t>(value);
+        *p++ = kInt64;
+        memcpy(p, &v, sizeof v);
+        p += sizeof v;
+      }
+    }
+    template <typename T, typename U, typename... Rest>
+    inline void encode(char *&p, T first, U second, Rest... rest)
+    {
+      encode(p, first);
+      encode(p, second, rest...);
+    }
+  }
+
+  // 参数按值传入，数组退化成指针
+  template <typename... Args>
+  inline void log(int fmtId, Args... args)
+  {
+    size_t n = sizeof(EntryHeader) + detail::argSize(args...);
+    char *entry = detail::reserve(n);
+    if (entry == nullptr)
+    {
+      return;
+    }
+    EntryHeader header = {static_cast<uint32_t>(fmtId), static_cast<uint32_t>(n), detail::ticks()};
+    memcpy(entry, &header, sizeof header);
+    char *p = entry + sizeof header;
+    detail::encode(p, args...);
+    detail::commit(entry, n);
+  }
+}
@@ -1,43 +1,116 @@
 #include "Buffer.h"
+#include "Probes.h"
 
 #include <error.h>
 #include <sys/uio.h>
+#include <sys/socket.h>
+#include <linux/errqueue.h>
+#include <string.h>
 #include <unistd.h>
 
 // Poller工作在LT模式,保证数据不会丢失
 
-ssize_t Buffer::readFd(int fd, int *saveErrno)
+ssize_t Buffer::readFd(int fd, int *saveErrno, size_t maxBytes)
 {
   char extrabuf[65536] = {0}; // 栈上的内存空间 64K
   struct iovec vec[2];
   const size_t wirteable = writeableBytes(); // 这是底层缓冲区剩余的可写空间大小
+  const int iovcnt = prepareRead(vec, extrabuf, sizeof extrabuf, maxBytes);
+  const ssize_t n = ::readv(fd, vec, iovcnt);
+  MYMUDUO_PROBE2(buffer_read, fd, n);
+  if (n < 0)
+  {
+    *saveErrno = errno;
+  }
+  else
+  {
+    commitRead(n, wirteable, extrabuf);
+  }
+  return n;
+}
+
+ssize_t Buffer::readFd(int fd, int *saveErrno, Timestamp *arrival, size_t maxBytes)
+{
+  char extrabuf[65536];
+  struct iovec vec[2];
+  const size_t wirteable = writeableBytes();
+
+  char control[CMSG_SPACE(sizeof(struct scm_timestamping))];
+  struct msghdr msg;
+  ::memset(&msg, 0, sizeof msg);
+  msg.msg_iov = vec;
+  msg.msg_iovlen = prepareRead(vec, extrabuf, sizeof extrabuf, maxBytes);
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof control;
+
+  const ssize_t n = ::recvmsg(fd, &msg, 0);
+  MYMUDUO_PROBE2(buffer_read, fd, n);
+  *arrival = Timestamp();
+  if (n < 0)
+  {
+    *saveErrno = errno;
+    return n;
+  }
+  for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg))
+  {
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPING)
+    {
+      // ts[0]是软件时间戳，ts[2]是硬件时间戳
+      const struct scm_timestamping *ts = reinterpret_cast<const struct scm_timestamping *>(CMSG_DATA(cmsg));
+      if (ts->ts[0].tv_sec != 0)
+      {
+        *arrival = Timestamp(static_cast<int64_t>(ts->ts[0].tv_sec) * Timestamp::kMicroSecondsPerSecond +
+                             ts->ts[0].tv_nsec / 1000);
+      }
+    }
+  }
+  commitRead(n, wirteable, extrabuf);
+  return n;
+}
+
+int Buffer::prepareRead(struct iovec *vec, char *extrabuf, size_t extraLen, size_t maxBytes)
+{
+  const size_t wirteable = writeableBytes();
   vec[0].iov_base = begin() + writerIndex_;
   vec[0].iov_len = wirteable;
 
   vec[1].iov_base = extrabuf;
-  vec[1].iov_len = sizeof extrabuf;
+  vec[1].iov_len = extraLen;
 
-  const int iovcnt = (wirteable < sizeof extrabuf) ? 2 : 1; // 至少读64K的数据
-  const ssize_t n = ::readv(fd, vec, iovcnt);
-  if (n < 0)
+  if (maxBytes > 0 && maxBytes <= wirteable)
   {
-    *saveErrno = errno;
+    vec[0].iov_len = maxBytes;
+    return 1;
   }
-  else if (n <= wirteable) // buffer的可写缓冲区已经够存储读出来的数据了
+  if (maxBytes > 0 && maxBytes - wirteable < extraLen)
+  {
+    vec[1].iov_len = maxBytes - wirteable;
+  }
+  return (wirteable < extraLen) ? 2 : 1; // 至少读64K的数据
+}
+
+void Buffer::commitRead(size_t n, size_t writeable, const char *extrabuf)
+{
+  if (n <= writeable) // buffer的可写缓冲区已经够存储读出来的数据了
   {
     writerIndex_ += n;
   }
   else // extrbuf里面也写入了数据
   {
     writerIndex_ = buffer_.size();
-    append(extrabuf, n - wirteable); // writeIndex_开始写n-writeable大小的数据，从buffer.size后开始写
+    append(extrabuf, n - writeable); // writeIndex_开始写n-writeable大小的数据，从buffer.size后开始写
   }
-  return n;
 }
 
-ssize_t Buffer::writeFd(int fd, int *saveErron)
+ssize_t Buffer::writeFd(int fd, int *saveErron, size_t maxBytes)
 {
-  ssize_t n = ::write(fd, peek(), readableBytes());
+  size_t len = readableBytes();
+  if (maxBytes > 0 && maxBytes < len)
+  {
+    len = maxBytes;
+  }
+  ssize_t n = ::write(fd, peek(), len);
+  MYMUDUO_PROBE2(buffer_write, fd, n);
   if (n < 0)
   {
     *saveErron = errno;
@@ -5,6 +5,11 @@
 #include <algorithm>
 #include <cstddef>
 
+#include "Timestamp.h"
+#include "MemoryBudget.h"
+
+struct iovec;
+
 // 网络库底层的缓冲区类型
 class Buffer
 {
@@ -15,7 +20,41 @@ public:
   explicit Buffer(size_t InitalSize = kInitalSize)
       : buffer_(kCheapPrepend + InitalSize),
         readerIndex_(kCheapPrepend),
-        writerIndex_(kCheapPrepend) {}
+        writerIndex_(kCheapPrepend),
+        budget_(nullptr) {}
+
+  // 拷贝出来的Buffer不记账
+  Buffer(const Buffer &rhs)
+      : buffer_(rhs.buffer_),
+        readerIndex_(rhs.readerIndex_),
+        writerIndex_(rhs.writerIndex_),
+        budget_(nullptr) {}
+
+  Buffer &operator=(const Buffer &rhs)
+  {
+    Buffer copy(rhs);
+    swap(copy);
+    return *this;
+  }
+
+  ~Buffer() { setBudget(nullptr); }
+
+  // 容量计入budget，之后的扩容、缩容和析构都会记账，nullptr表示不记账(默认)
+  void setBudget(MemoryBudget *budget)
+  {
+    if (budget_ != nullptr)
+    {
+      budget_->charge(-static_cast<int64_t>(buffer_.capacity()));
+    }
+    budget_ = budget;
+    if (budget_ != nullptr)
+    {
+      budget_->charge(static_cast<int64_t>(buffer_.capacity()));
+    }
+  }
+
+  // 底层占用的内存
+  size_t capacity() const { return buffer_.capacity(); }
 
   size_t readableBytes() const
   {
@@ -98,12 +137,41 @@ public:
     return begin() + writerIndex_;
   }
 
-  // 从fd上读取数据
-  ssize_t readFd(int fd, int *saveErrno);
-  // 通过fd发送数据
-  ssize_t writeFd(int fd, int *saveErrno);
+  // 只交换数据，各自的budget不变，容量差额分别记账
+  void swap(Buffer &rhs)
+  {
+    const size_t capacity = buffer_.capacity();
+    const size_t rhsCapacity = rhs.buffer_.capacity();
+    buffer_.swap(rhs.buffer_);
+    std::swap(readerIndex_, rhs.readerIndex_);
+    std::swap(writerIndex_, rhs.writerIndex_);
+    recharge(capacity);
+    rhs.recharge(rhsCapacity);
+  }
+
+  // 没有可读数据时把扩容出来的内存还回去，恢复成初始大小
+  void shrink()
+  {
+    if (readableBytes() == 0 && buffer_.capacity() > kCheapPrepend + kInitalSize)
+    {
+      Buffer().swap(*this);
+    }
+  }
+
+  // 从fd上读取数据，maxBytes>0时最多读maxBytes字节
+  ssize_t readFd(int fd, int *saveErrno, size_t maxBytes = 0);
+  // 用recvmsg读取，同时取出内核给最新那部分数据打的软件接收时间戳(需先开启SO_TIMESTAMPING)，
+  // 没有时间戳时*arrival为无效的Timestamp
+  ssize_t readFd(int fd, int *saveErrno, Timestamp *arrival, size_t maxBytes = 0);
+  // 通过fd发送数据，maxBytes>0时最多发maxBytes字节
+  ssize_t writeFd(int fd, int *saveErrno, size_t maxBytes = 0);
 
 private:
+  // 填好readv/recvmsg用的iovec：先填缓冲区剩余空间，再填栈上的extrabuf，返回用到的段数
+  int prepareRead(struct iovec *vec, char *extrabuf, size_t extraLen, size_t maxBytes);
+  // readv/recvmsg读到n字节后调整writerIndex_，超出writeable的部分在extrabuf里
+  void commitRead(size_t n, size_t writeable, const char *extrabuf);
+
   char *begin()
   {
     return &*buffer_.begin();
@@ -114,11 +182,22 @@ private:
     return &*buffer_.begin();
   }
 
+  // 容量从oldCapacity变成了当前值，差额计入budget
+  void recharge(size_t oldCapacity)
+  {
+    if (budget_ != nullptr && buffer_.capacity() != oldCapacity)
+    {
+      budget_->charge(static_cast<int64_t>(buffer_.capacity()) - static_cast<int64_t>(oldCapacity));
+    }
+  }
+
   void makeSpace(size_t len)
   {
     if (writeableBytes() + prependableBytes() < len + kCheapPrepend)
     {
+      const size_t oldCapacity = buffer_.capacity();
       buffer_.resize(writerIndex_ + len);
+      recharge(oldCapacity);
     }
     else
     {
@@ -134,4 +213,5 @@ private:
   std::vector<char> buffer_;
   size_t readerIndex_;
   size_t writerIndex_;
+  MemoryBudget *budget_;
 };
\ No newline at end of file
@@ -1,3 +1,5 @@
+#define LOG_MODULE Logger::kChannel
+
 #include "Channel.h"
 #include "EventLoop.h"
 #include "Logger.h"
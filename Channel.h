@@ -57,7 +57,7 @@ public:
   }
   void disableAll()
   {
-    events_ |= kNoneEvent_;
+    events_ = kNoneEvent_;
     update();
   }
 
@@ -72,6 +72,8 @@ public:
 
   // 此channel的poller
   EventLoop *ownerLoop() { return loop_; }
+  // 连接迁移时使用，调用前channel必须已经从原loop中remove
+  void setOwnerLoop(EventLoop *loop) { loop_ = loop; }
   void remove(); // 删除channel
 
 private:
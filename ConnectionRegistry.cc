@@ -0,0 +1,80 @@
+#include "ConnectionRegistry.h"
+#include "EventLoop.h"
+#include "TcpConnection.h"
+
+#include <memory>
+#include <vector>
+
+ConnectionRegistry::ConnectionRegistry()
+    : size_(0)
+{
+}
+
+void ConnectionRegistry::add(const TcpConnectionPtr &conn)
+{
+  Shard &shard = shardOf(conn->id());
+  std::unique_lock<std::mutex> lock(shard.mutex);
+  if (shard.connections.emplace(conn->id(), conn).second)
+  {
+    size_.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void ConnectionRegistry::remove(const TcpConnectionPtr &conn)
+{
+  Shard &shard = shardOf(conn->id());
+  std::unique_lock<std::mutex> lock(shard.mutex);
+  if (shard.connections.erase(conn->id()) > 0)
+  {
+    size_.fetch_sub(1, std::memory_order_relaxed);
+  }
+}
+
+TcpConnectionPtr ConnectionRegistry::find(uint64_t id) const
+{
+  const Shard &shard = shardOf(id);
+  std::unique_lock<std::mutex> lock(shard.mutex);
+  auto it = shard.connections.find(id);
+  return it != shard.connections.end() ? it->second : TcpConnectionPtr();
+}
+
+size_t ConnectionRegistry::broadcast(const Filter &filter, const Payload &payload) const
+{
+  using Batch = std::vector<TcpConnectionPtr>;
+
+  // 按所属loop分组，每次只锁一个分片
+  std::unordered_map<EventLoop *, std::shared_ptr<Batch>> batches;
+  size_t total = 0;
+  for (const Shard &shard : shards_)
+  {
+    std::unique_lock<std::mutex> lock(shard.mutex);
+    for (const auto &item : shard.connections)
+    {
+      std::shared_ptr<Batch> &batch = batches[item.second->getLoop()];
+      if (!batch)
+      {
+        batch = std::make_shared<Batch>();
+      }
+      batch->push_back(item.second);
+    }
+    total += shard.connections.size();
+  }
+
+  // 放开分片锁之后分组用的EventLoop*可能已经失效：连接迁走后原loop可以被退役析构。
+  // 所以经由组里第一个连接投递，连接总是投到自己当前所在的loop
+  for (auto &item : batches)
+  {
+    std::shared_ptr<Batch> batch = item.second;
+    TcpConnectionPtr first = batch->front();
+    first->queueInLoop([batch, filter, payload]()
+                       {
+      for (const TcpConnectionPtr &conn : *batch)
+      {
+        if (!filter || filter(conn))
+        {
+          conn->send(payload); // 分组后才迁走的连接在这里转交给新loop
+        }
+      } });
+  }
+  return total;
+}
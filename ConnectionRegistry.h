@@ -0,0 +1,57 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+#include "Payload.h"
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/**
+ * 按连接id(TcpConnection::id())查找连接的表，可在任意线程访问。
+ * 按id分成kShards个分片，每片一把锁，查找只锁一个分片；增删由TcpServer在baseloop线程中做。
+ * broadcast不为每个连接投递任务：先按连接当前所属的loop分组，每个loop只投递一个任务，
+ * 在loop线程里逐个过滤、发送，10万连接的广播只唤醒loop个数次。
+ */
+class ConnectionRegistry : noncopyable
+{
+public:
+  // 在连接所属的loop线程中调用，返回false的连接跳过
+  using Filter = std::function<bool(const TcpConnectionPtr &)>;
+
+  ConnectionRegistry();
+
+  void add(const TcpConnectionPtr &conn);
+  void remove(const TcpConnectionPtr &conn);
+
+  // 找不到(没建立或已关闭)时返回空
+  TcpConnectionPtr find(uint64_t id) const;
+  size_t size() const { return size_.load(std::memory_order_relaxed); }
+
+  // 把payload发给filter选中的连接(filter为空时发给所有连接)，返回投递时的候选连接数
+  // 连接的集合在调用时确定，之后建立的连接收不到；投递后迁移走的连接由TcpConnection::send转交给新loop
+  size_t broadcast(const Filter &filter, const Payload &payload) const;
+  size_t broadcast(const Payload &payload) const { return broadcast(Filter(), payload); }
+  size_t broadcast(const Filter &filter, const std::string &message) const
+  {
+    return broadcast(filter, Payload::copyOf(message.data(), message.size()));
+  }
+
+private:
+  static const int kShards = 16;
+
+  struct Shard
+  {
+    mutable std::mutex mutex;
+    std::unordered_map<uint64_t, TcpConnectionPtr> connections;
+  };
+
+  const Shard &shardOf(uint64_t id) const { return shards_[id % kShards]; }
+  Shard &shardOf(uint64_t id) { return shards_[id % kShards]; }
+
+  Shard shards_[kShards];
+  std::atomic<size_t> size_;
+};
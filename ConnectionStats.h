@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdint.h>
+
+// 一个或多个连接的流量计数快照
+struct ConnectionStats
+{
+  ConnectionStats()
+      : connections(0), bytesRead(0), bytesWritten(0), readCalls(0), writeCalls(0),
+        highWaterEvents(0), outputBufferedNs(0), zeroCopySends(0), zeroCopyBytes(0), zeroCopyCopied(0) {}
+
+  void merge(const ConnectionStats &other)
+  {
+    connections += other.connections;
+    bytesRead += other.bytesRead;
+    bytesWritten += other.bytesWritten;
+    readCalls += other.readCalls;
+    writeCalls += other.writeCalls;
+    highWaterEvents += other.highWaterEvents;
+    outputBufferedNs += other.outputBufferedNs;
+    zeroCopySends += other.zeroCopySends;
+    zeroCopyBytes += other.zeroCopyBytes;
+    zeroCopyCopied += other.zeroCopyCopied;
+  }
+
+  uint64_t connections;      // 合并了几个连接
+  uint64_t bytesRead;
+  uint64_t bytesWritten;
+  uint64_t readCalls;        // read/readv系统调用次数
+  uint64_t writeCalls;       // write系统调用次数
+  uint64_t highWaterEvents;  // outputBuffer越过高水位的次数
+  uint64_t outputBufferedNs; // outputBuffer非空(数据等内核发送)的累计时间
+  uint64_t zeroCopySends;    // 带MSG_ZEROCOPY的sendmsg次数
+  uint64_t zeroCopyBytes;    // 其中发出的字节数
+  uint64_t zeroCopyCopied;   // 内核通知实际上还是拷贝了的次数(比如loopback)
+};
@@ -0,0 +1,145 @@
+#include "CpuTopology.h"
+#include "Logger.h"
+
+#include <set>
+#include <utility>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <dirent.h>
+#include <sched.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+namespace
+{
+  // 读取/sys/devices/system/cpu/cpuN/topology/下的一个整数
+  int readTopology(int cpu, const char *name)
+  {
+    char path[128] = {0};
+    snprintf(path, sizeof path, "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, name);
+    FILE *fp = ::fopen(path, "r");
+    if (fp == nullptr)
+    {
+      return -1;
+    }
+    int value = -1;
+    if (::fscanf(fp, "%d", &value) != 1)
+    {
+      value = -1;
+    }
+    ::fclose(fp);
+    return value;
+  }
+}
+
+namespace CpuTopology
+{
+  std::vector<int> allowedCpus()
+  {
+    std::vector<int> cpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (::sched_getaffinity(0, sizeof set, &set) == 0)
+    {
+      for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+      {
+        if (CPU_ISSET(cpu, &set))
+        {
+          cpus.push_back(cpu);
+        }
+      }
+    }
+    return cpus;
+  }
+
+  std::vector<int> physicalCores()
+  {
+    std::vector<int> cores;
+    std::set<std::pair<int, int>> seen; // (package, core)
+    for (int cpu : allowedCpus())
+    {
+      std::pair<int, int> key(packageIdOfCpu(cpu), coreIdOfCpu(cpu));
+      if (key.second < 0 || seen.insert(key).second)
+      {
+        cores.push_back(cpu);
+      }
+    }
+    return cores;
+  }
+
+  int numaNodeOfCpu(int cpu)
+  {
+    // cpuN目录下有一个nodeM的符号链接指向所属节点
+    char path[64] = {0};
+    snprintf(path, sizeof path, "/sys/devices/system/cpu/cpu%d", cpu);
+    DIR *dir = ::opendir(path);
+    if (dir == nullptr)
+    {
+      return 0;
+    }
+    int node = 0;
+    while (dirent *ent = ::readdir(dir))
+    {
+      if (::strncmp(ent->d_name, "node", 4) == 0 && ::sscanf(ent->d_name + 4, "%d", &node) == 1)
+      {
+        break;
+      }
+    }
+    ::closedir(dir);
+    return node;
+  }
+
+  int coreIdOfCpu(int cpu)
+  {
+    return readTopology(cpu, "core_id");
+  }
+
+  int packageIdOfCpu(int cpu)
+  {
+    return readTopology(cpu, "physical_package_id");
+  }
+
+  int currentCpu()
+  {
+    return ::sched_getcpu();
+  }
+
+  bool bindCurrentThread(const std::vector<int> &cpus)
+  {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus)
+    {
+      CPU_SET(cpu, &set);
+    }
+    int err = ::pthread_setaffinity_np(::pthread_self(), sizeof set, &set);
+    if (err != 0)
+    {
+      LOG_ERROR("pthread_setaffinity_np err:%d \n", err);
+      return false;
+    }
+    return true;
+  }
+
+  bool preferMemoryNode(int node)
+  {
+    if (node < 0)
+    {
+      return false;
+    }
+    // 不依赖libnuma，直接走系统调用；节点号可能超过64，按位图长度分配
+    const size_t kBits = sizeof(unsigned long) * 8;
+    std::vector<unsigned long> mask(node / kBits + 1, 0);
+    mask[node / kBits] = 1UL << (node % kBits);
+    // 内核按maxnode-1位读位图，多给一位
+    if (::syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask.data(), mask.size() * kBits + 1) != 0)
+    {
+      LOG_ERROR("set_mempolicy node:%d err:%d \n", node, errno);
+      return false;
+    }
+    return true;
+  }
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <vector>
+
+// 读取/sys下的cpu拓扑，给loop线程绑核和NUMA内存放置用
+namespace CpuTopology
+{
+  // 当前进程允许运行的逻辑cpu
+  std::vector<int> allowedCpus();
+
+  // 每个物理核取一个逻辑cpu(超线程的兄弟核只保留编号最小的那个)
+  std::vector<int> physicalCores();
+
+  // cpu所在的NUMA节点，读取失败返回0
+  int numaNodeOfCpu(int cpu);
+
+  // cpu所在的物理核编号(socket内唯一)和socket编号，读取失败返回-1
+  int coreIdOfCpu(int cpu);
+  int packageIdOfCpu(int cpu);
+
+  // 当前线程正在运行的cpu
+  int currentCpu();
+
+  // 把当前线程绑定到cpus上
+  bool bindCurrentThread(const std::vector<int> &cpus);
+
+  // 当前线程后续分配的内存优先从node节点分配
+  bool preferMemoryNode(int node);
+}
@@ -1,6 +1,9 @@
+#define LOG_MODULE Logger::kPoller
+
 #include "EPollPoller.h"
 #include "Logger.h"
 #include "Channel.h"
+#include "Probes.h"
 
 #include <error.h>
 #include <unistd.h>
@@ -31,8 +34,10 @@ Timestamp EPollPoller::poll(int timeoutMs, ChannelList *activeChannels)
   // 实际上应该用logdebug输出更加合理
   LOG_INFO("func=%s => fd total count:%lu\n", __FUNCTION__, channels_.size());
 
+  MYMUDUO_PROBE3(poll_enter, ownerLoop(), epollfd_, channels_.size());
   int numEvents = epoll_wait(epollfd_, &*events_.begin(), static_cast<int>(events_.size()), timeoutMs);
   int saveErrno = errno;
+  MYMUDUO_PROBE3(poll_exit, ownerLoop(), epollfd_, numEvents);
   Timestamp now(Timestamp::now());
 
   if (numEvents > 0)
@@ -2,8 +2,16 @@
 #include "Logger.h"
 #include "Poller.h"
 #include "Channel.h"
+#include "Probes.h"
+#include "TrafficShaper.h"
+#include "MemoryGovernor.h"
+#include "TcpConnection.h"
 
+#include <cxxabi.h>
+#include <stdlib.h>
 #include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <pthread.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
@@ -30,10 +38,28 @@ EventLoop::EventLoop()
     : looping_(false),
       quit_(false),
       callingPendingFunctors_(false),
+      pendingFunctorCount_(0),
+      sendRings_(nullptr),
+      polling_(false),
       threadId_(CurrentThread::tid()),
       poller_(Poller::newDefaultPoller(this)),
       wakeupFd_(createEventfd()),
-      wakeupChannel_(new Channel(this, wakeupFd_))
+      wakeupChannel_(new Channel(this, wakeupFd_)),
+      connectionCount_(0),
+      pendingBytes_(0),
+      maxConnections_(0),
+      maxPendingFunctors_(0),
+      maxPendingBytes_(0),
+      cpu_(-1),
+      numaNode_(-1),
+      numaLocalMemory_(false),
+      wakeups_(0),
+      nextTimerId_(1),
+      memoryBudget_(MemoryBudget::process()),
+      slowCallbackNs_(0),
+      busySinceNs_(0),
+      currentFd_(-1),
+      currentFunctor_(nullptr)
 {
   LOG_DEBUG("EventLoop created %p in thread %d\n", this, threadId_);
   if (t_loopInThisThread_)
@@ -46,6 +72,11 @@ EventLoop::EventLoop()
     t_loopInThisThread_ = this;
   }
 
+  if (::pthread_getcpuclockid(::pthread_self(), &cpuClock_) != 0)
+  {
+    cpuClock_ = CLOCK_THREAD_CPUTIME_ID;
+  }
+
   // 设置wakeupfd的事件类型以及发生事件后的回调操作(唤醒subloop)
   wakeupChannel_->setReadCallback(std::bind(&EventLoop::handleRead, this));
   // 每一个eventloop都将监听wakeupchannel的EPOLLIN的读事件了
@@ -54,6 +85,13 @@ EventLoop::EventLoop()
 
 EventLoop::~EventLoop()
 {
+  drainSendRings(); // 放掉列表上对连接的引用
+  for (auto &item : timers_)
+  {
+    item.second->disableAll();
+    item.second->remove();
+    ::close(item.second->fd());
+  }
   wakeupChannel_->disableAll();
   wakeupChannel_->remove();
   ::close(wakeupFd_);
@@ -68,6 +106,7 @@ void EventLoop::handleRead()
   {
     LOG_ERROR("EventLoop::handleRead() reads %d bytes instead of 8\n", n);
   }
+  wakeups_.store(wakeups_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
 }
 
 // 开启事件循环
@@ -78,22 +117,70 @@ void EventLoop::loop()
 
   LOG_INFO("EventLoop %p start looping \n", this);
 
+  int64_t iterationStart = Timestamp::monotonicNanos();
   while (!quit_)
   {
     activeChannels_.clear();
+    busySinceNs_.store(0, std::memory_order_relaxed);
     // 监听两类fd，一种是clientfd,一种是wakeupfd
-    pollReturnTime_ = poller_->poll(kPollTimeMs, &activeChannels_);
+    // 挂待发送列表的线程只在loop阻塞时唤醒它，置位之后再看一眼列表，不空就不阻塞
+    polling_.store(true, std::memory_order_seq_cst);
+    int timeoutMs = sendRings_.load(std::memory_order_seq_cst) != nullptr ? 0 : kPollTimeMs;
+    pollReturnTime_ = poller_->poll(timeoutMs, &activeChannels_);
+    polling_.store(false, std::memory_order_relaxed);
+    int64_t pollReturn = Timestamp::monotonicNanos();
+    busySinceNs_.store(pollReturn, std::memory_order_relaxed);
+    pollWaitHist_.record(pollReturn - iterationStart);
+    activeChannelsHist_.record(activeChannels_.size());
 
+    const int64_t slowNs = slowCallbackNs_.load(std::memory_order_relaxed);
+    int64_t channelsDone = pollReturn;
     for (Channel *channel : activeChannels_)
     {
+      currentFd_.store(channel->fd(), std::memory_order_relaxed);
       // Poller能够监听哪些channel发生事件，上报给EventLoop
       channel->handleEvent(pollReturnTime_);
+      if (slowNs > 0)
+      {
+        // 每个回调结束时取一次时间，上一个回调的结束就是下一个的开始
+        int64_t now = Timestamp::monotonicNanos();
+        if (now - channelsDone > slowNs)
+        {
+          LOG_ERROR("EventLoop %p slow callback on fd %d took %.3f ms\n",
+                    this, channel->fd(), (now - channelsDone) / 1e6);
+        }
+        channelsDone = now;
+      }
+    }
+    currentFd_.store(-1, std::memory_order_relaxed);
+    if (!activeChannels_.empty())
+    {
+      if (slowNs <= 0)
+      {
+        channelsDone = Timestamp::monotonicNanos();
+      }
+      channelHist_.record(channelsDone - pollReturn);
     }
+    drainSendRings();
     // 执行当前EventLoop事件循环需要处理的回调操作
     // mianloop事先注册一个回调cb,需要一个subloop来执行
     // wake up subloop后执行之前mianloop注册的cb
-    doPendingFunctors();
+    if (doPendingFunctors(slowNs) > 0)
+    {
+      iterationStart = Timestamp::monotonicNanos();
+      functorHist_.record(iterationStart - channelsDone);
+    }
+    else
+    {
+      iterationStart = channelsDone;
+    }
   }
+  // 其他线程在最后一轮交换之后投递的回调还留在队列里，loop对象随后就会析构，退出前全部执行掉；
+  // 回调里再投递的回调也一并执行
+  while (doPendingFunctors(slowCallbackNs_.load(std::memory_order_relaxed)) > 0)
+  {
+  }
+  busySinceNs_.store(0, std::memory_order_relaxed);
 
   LOG_INFO("EventLoop %p stop looping.\n", this);
   looping_ = false;
@@ -130,7 +217,9 @@ void EventLoop::queueInLoop(Functor cb)
   {
     std::unique_lock<std::mutex> lock(mutex_);
     pendingFunctors_.emplace_back(cb);
+    pendingFunctorCount_.store(pendingFunctors_.size(), std::memory_order_relaxed);
   }
+  MYMUDUO_PROBE2(queue_in_loop, this, isInLoopThread());
 
   // 唤醒相应的loop所在线程
   //||callingPendingFunctors_的意思是，当前loop正在执行回调，但是loop又有了新的回调，在其执行完上次回调后，再次唤醒执行新的回调
@@ -140,9 +229,45 @@ void EventLoop::queueInLoop(Functor cb)
   }
 }
 
+void EventLoop::queueSendRing(TcpConnection *conn)
+{
+  TcpConnection *head = sendRings_.load(std::memory_order_relaxed);
+  do
+  {
+    conn->setNextSendRing(head);
+  } while (!sendRings_.compare_exchange_weak(head, conn, std::memory_order_seq_cst, std::memory_order_relaxed));
+
+  // 列表原来不空时已经有人负责唤醒了；loop没有阻塞在poll里时，它在下次poll之前会看到列表不空
+  if (head == nullptr && !isInLoopThread() && polling_.load(std::memory_order_seq_cst))
+  {
+    wakeup();
+  }
+}
+
+void EventLoop::drainSendRings()
+{
+  TcpConnection *conn = sendRings_.exchange(nullptr, std::memory_order_acquire);
+  // 栈是后进先出，反转成挂上的顺序
+  TcpConnection *ordered = nullptr;
+  while (conn != nullptr)
+  {
+    TcpConnection *next = conn->nextSendRing();
+    conn->setNextSendRing(ordered);
+    ordered = conn;
+    conn = next;
+  }
+  while (ordered != nullptr)
+  {
+    TcpConnection *next = ordered->nextSendRing();
+    ordered->handleSendRing(); // 可能放掉最后一个引用，之后不能再访问ordered
+    ordered = next;
+  }
+}
+
 // 用来唤醒loop所在的线程,向wakupfd_写一个数据,使其有数据可读发生读事件，也就是唤醒
 void EventLoop::wakeup()
 {
+  MYMUDUO_PROBE1(wakeup, this);
   uint64_t one = 1;
   ssize_t n = write(wakeupFd_, &one, sizeof one);
   if (n != sizeof one)
@@ -166,7 +291,7 @@ bool EventLoop::hasChannel(Channel *channel)
 }
 
 // 执行回调
-void EventLoop::doPendingFunctors()
+size_t EventLoop::doPendingFunctors(int64_t slowNs)
 {
   std::vector<Functor> functors;
   callingPendingFunctors_ = true;
@@ -175,12 +300,184 @@ void EventLoop::doPendingFunctors()
     std::unique_lock<std::mutex> lock(mutex_);
     // 将pendingFunctors与局部变量交换后置空，方便其他loop继续往其里面添加cb
     functors.swap(pendingFunctors_);
+    pendingFunctorCount_.store(0, std::memory_order_relaxed);
   }
 
+  pendingFunctorsHist_.record(functors.size());
+  int64_t start = slowNs > 0 ? Timestamp::monotonicNanos() : 0;
   for (const Functor &functor : functors)
   {
+    currentFunctor_.store(&functor.target_type(), std::memory_order_relaxed);
     functor(); // 执行当前loop需要执行的回调操作
+    if (slowNs > 0)
+    {
+      int64_t now = Timestamp::monotonicNanos();
+      if (now - start > slowNs)
+      {
+        int status = 0;
+        char *name = abi::__cxa_demangle(functor.target_type().name(), nullptr, nullptr, &status);
+        LOG_ERROR("EventLoop %p slow functor %s took %.3f ms\n",
+                  this, name != nullptr ? name : functor.target_type().name(), (now - start) / 1e6);
+        ::free(name);
+      }
+      start = now;
+    }
   }
+  currentFunctor_.store(nullptr, std::memory_order_relaxed);
 
   callingPendingFunctors_ = false;
+  return functors.size();
+}
+
+int64_t EventLoop::runEvery(double interval, Functor cb)
+{
+  return addTimer(interval, std::move(cb), true);
+}
+
+int64_t EventLoop::runAfter(double delay, Functor cb)
+{
+  return addTimer(delay, std::move(cb), false);
+}
+
+int64_t EventLoop::addTimer(double interval, Functor cb, bool repeat)
+{
+  int timerfd = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (timerfd < 0)
+  {
+    LOG_FATAL("timerfd_create error:%d \n", errno);
+  }
+  itimerspec spec;
+  spec.it_interval.tv_sec = static_cast<time_t>(interval);
+  spec.it_interval.tv_nsec = static_cast<long>((interval - spec.it_interval.tv_sec) * 1000000000);
+  if (spec.it_interval.tv_sec == 0 && spec.it_interval.tv_nsec == 0)
+  {
+    spec.it_interval.tv_nsec = 1000; // 0会让定时器停掉
+  }
+  spec.it_value = spec.it_interval;
+  if (!repeat)
+  {
+    spec.it_interval.tv_sec = 0;
+    spec.it_interval.tv_nsec = 0;
+  }
+  ::timerfd_settime(timerfd, 0, &spec, nullptr);
+
+  // fd会被复用，用单调递增的id标识定时器，旧id的cancel不会误伤后来复用同一个fd的定时器
+  const int64_t timerId = nextTimerId_.fetch_add(1, std::memory_order_relaxed);
+  runInLoop(std::bind(&EventLoop::addTimerInLoop, this, timerId, timerfd, std::move(cb), repeat));
+  return timerId;
 }
+
+void EventLoop::cancel(int64_t timerId)
+{
+  // 先标记，同一轮里随后到期的回调看到标记就不再执行；
+  // channel的清理总是排队执行，避免在定时器自己的回调里析构它的channel
+  {
+    std::unique_lock<std::mutex> lock(timerMutex_);
+    cancelledTimers_.insert(timerId);
+  }
+  queueInLoop(std::bind(&EventLoop::cancelInLoop, this, timerId));
+}
+
+bool EventLoop::timerCancelled(int64_t timerId)
+{
+  std::unique_lock<std::mutex> lock(timerMutex_);
+  return cancelledTimers_.count(timerId) > 0;
+}
+
+TrafficShaper *EventLoop::trafficShaper()
+{
+  if (!trafficShaper_)
+  {
+    trafficShaper_.reset(new TrafficShaper(this));
+  }
+  return trafficShaper_.get();
+}
+
+bool EventLoop::overloaded() const
+{
+  int maxConnections = maxConnections_.load(std::memory_order_relaxed);
+  size_t maxPendingFunctors = maxPendingFunctors_.load(std::memory_order_relaxed);
+  int64_t maxPendingBytes = maxPendingBytes_.load(std::memory_order_relaxed);
+  return (maxConnections > 0 && connectionCount() >= maxConnections) ||
+         (maxPendingFunctors > 0 && pendingFunctorCount() >= maxPendingFunctors) ||
+         (maxPendingBytes > 0 && pendingBytes() >= maxPendingBytes);
+}
+
+MemoryGovernor *EventLoop::memoryGovernor()
+{
+  if (!memoryGovernor_)
+  {
+    memoryGovernor_.reset(new MemoryGovernor(this));
+  }
+  return memoryGovernor_.get();
+}
+
+size_t EventLoop::numMemoryPaused() const
+{
+  return memoryGovernor_ ? memoryGovernor_->numPaused() : 0;
+}
+
+int64_t EventLoop::cpuTimeMicros() const
+{
+  timespec ts;
+  if (::clock_gettime(cpuClock_, &ts) != 0)
+  {
+    return 0;
+  }
+  return static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+LoopMetrics EventLoop::metrics() const
+{
+  LoopMetrics m;
+  m.loops = 1;
+  m.wakeups = wakeups_.load(std::memory_order_relaxed);
+  m.pollWaitNs = pollWaitHist_.snapshot();
+  m.channelNs = channelHist_.snapshot();
+  m.functorNs = functorHist_.snapshot();
+  m.pendingFunctors = pendingFunctorsHist_.snapshot();
+  m.activeChannels = activeChannelsHist_.snapshot();
+  m.socketQueueNs = socketQueueHist_.snapshot();
+  m.dispatchDelayNs = dispatchDelayHist_.snapshot();
+  m.iterations = m.pollWaitNs.count;
+  m.channelEvents = m.activeChannels.sum;
+  m.functorsRun = m.pendingFunctors.sum;
+  return m;
+}
+
+void EventLoop::addTimerInLoop(int64_t timerId, int timerfd, Functor cb, bool repeat)
+{
+  Channel *channel = new Channel(this, timerfd);
+  timers_[timerId].reset(channel);
+  channel->setReadCallback([this, timerId, timerfd, cb, repeat](Timestamp)
+                           {
+    uint64_t expirations = 0;
+    ::read(timerfd, &expirations, sizeof expirations);
+    if (timerCancelled(timerId))
+    {
+      return; // 回调里可能用到的对象已经随cancel析构了
+    }
+    cb();
+    if (!repeat)
+    {
+      cancel(timerId);
+    } });
+  channel->enableReading();
+}
+
+void EventLoop::cancelInLoop(int64_t timerId)
+{
+  {
+    std::unique_lock<std::mutex> lock(timerMutex_);
+    cancelledTimers_.erase(timerId);
+  }
+  auto it = timers_.find(timerId);
+  if (it != timers_.end())
+  {
+    const int timerfd = it->second->fd();
+    it->second->disableAll();
+    it->second->remove();
+    timers_.erase(it);
+    ::close(timerfd);
+  }
+}
\ No newline at end of file
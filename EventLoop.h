@@ -5,13 +5,23 @@
 #include <atomic>
 #include <memory>
 #include <mutex>
+#include <map>
+#include <set>
+#include <typeinfo>
+#include <time.h>
 
 #include "noncopyable.h"
 #include "Timestamp.h"
 #include "CurrentThread.h"
+#include "Histogram.h"
+#include "LoopMetrics.h"
+#include "MemoryBudget.h"
 
 class Channel;
 class Poller;
+class TrafficShaper;
+class MemoryGovernor;
+class TcpConnection;
 
 // 事件循环类，主要包括两大模块，Channel、Poller(epoll的抽象)
 
@@ -25,9 +35,10 @@ public:
 
   // 开启事件循环
   void loop();
-  // 退出事件循环
+  // 退出事件循环，退出前执行完队列里剩下的回调，quit之前投递的回调都不会丢
   void quit();
 
+  // 本轮poll返回的时间，同一轮里的回调用它代替Timestamp::now()，省掉重复取时间
   Timestamp pollReturnTime() const { return pollReturnTime_; }
 
   // 在当前loop中执行
@@ -38,6 +49,41 @@ public:
   // 用来唤醒loop所在的线程
   void wakeup();
 
+  // 其他线程写了conn的发送环后把它挂到本loop的待发送列表上，列表从空变为非空时才唤醒loop，可在任意线程调用
+  // 由TcpConnection保证一个连接同时只挂一次；loop每轮在pending functor之前一次取走整个列表
+  void queueSendRing(TcpConnection *conn);
+
+  // 每隔interval秒在loop线程中执行一次cb，可在任意线程调用，返回值用于cancel
+  // 定时器id单调递增、不会重复使用，cancel一个已经结束的定时器什么也不做
+  int64_t runEvery(double interval, Functor cb);
+  // delay秒后在loop线程中执行一次cb
+  int64_t runAfter(double delay, Functor cb);
+  // cancel返回后定时器的回调不会再执行，即使它和cancel在同一轮poll里到期；timerfd的清理排队在loop线程里做
+  void cancel(int64_t timerId);
+
+  // 本loop的限速器，第一次调用时创建，只能在loop线程中调用
+  TrafficShaper *trafficShaper();
+
+  // 本loop上连接缓冲区的内存预算，父预算是MemoryBudget::process()，可在任意线程调用
+  MemoryBudget *memoryBudget() { return &memoryBudget_; }
+  const MemoryBudget *memoryBudget() const { return &memoryBudget_; }
+  // 管理因预算用尽而暂停读的连接，第一次调用时创建，只能在loop线程中调用
+  MemoryGovernor *memoryGovernor();
+  // 暂停读的连接数，没有创建过MemoryGovernor时为0，只能在loop线程中调用
+  size_t numMemoryPaused() const;
+
+  // loop线程累计占用的cpu时间(微秒)，可在任意线程调用
+  int64_t cpuTimeMicros() const;
+
+  // 运行指标快照，可在任意线程调用，不加锁，各项之间可能差一轮
+  LoopMetrics metrics() const;
+  // 在loop线程中调用：记录一次带内核接收时间戳的读，两段排队时间见LoopMetrics
+  void recordReceiveDelay(int64_t socketQueueNs, int64_t dispatchDelayNs)
+  {
+    socketQueueHist_.record(socketQueueNs > 0 ? socketQueueNs : 0);
+    dispatchDelayHist_.record(dispatchDelayNs > 0 ? dispatchDelayNs : 0);
+  }
+
   // eventloop调用loop的方法
   void updateChannel(Channel *channel);
   void removeChannel(Channel *channel);
@@ -45,10 +91,63 @@ public:
 
   // 判断eventloop是否在自己的线程里面
   bool isInLoopThread() const { return threadId_ == CurrentThread::tid(); }
+  pid_t threadId() const { return threadId_; }
+
+  // 单个channel回调或pending functor超过seconds秒时打印一条ERROR日志，0表示关闭(默认)，可在任意线程调用
+  // 开启后每个回调多取一次时间
+  void setSlowCallbackThreshold(double seconds)
+  {
+    slowCallbackNs_.store(static_cast<int64_t>(seconds * 1e9), std::memory_order_relaxed);
+  }
+
+  // 心跳，供LoopWatchdog在其他线程读取
+  // 本轮poll返回的时刻(Timestamp::monotonicNanos)，阻塞在poll里时为0
+  int64_t busySinceNanos() const { return busySinceNs_.load(std::memory_order_relaxed); }
+  // 正在处理的channel的fd，不在channel回调里时为-1
+  int currentFd() const { return currentFd_.load(std::memory_order_relaxed); }
+  // 正在执行的pending functor的类型，不在functor里时为nullptr
+  const std::type_info *currentFunctor() const { return currentFunctor_.load(std::memory_order_relaxed); }
+
+  // 负载计数，baseloop选择subloop时读取；连接数在baseloop选中本loop时加一，连接销毁或迁走时减一，
+  // 待发送字节数由TcpConnection在本loop线程中更新
+  int connectionCount() const { return connectionCount_.load(std::memory_order_relaxed); }
+  int64_t pendingBytes() const { return pendingBytes_.load(std::memory_order_relaxed); }
+  void adjustConnectionCount(int delta) { connectionCount_.fetch_add(delta, std::memory_order_relaxed); }
+  void adjustPendingBytes(int64_t delta) { pendingBytes_.fetch_add(delta, std::memory_order_relaxed); }
+
+  // 队列里还没执行的pending functor个数，可在任意线程调用
+  size_t pendingFunctorCount() const { return pendingFunctorCount_.load(std::memory_order_relaxed); }
+
+  // 过载判定：连接数、pending functor个数或outputBuffer待发送字节数任一达到上限即为过载，上限为0表示不检查该项
+  // 由TcpServer::setAdmissionLimits设置，应用可在任意线程用overloaded()决定是否降级(例如拒绝昂贵的请求)
+  void setOverloadLimits(int maxConnections, size_t maxPendingFunctors, int64_t maxPendingBytes)
+  {
+    maxConnections_.store(maxConnections, std::memory_order_relaxed);
+    maxPendingFunctors_.store(maxPendingFunctors, std::memory_order_relaxed);
+    maxPendingBytes_.store(maxPendingBytes, std::memory_order_relaxed);
+  }
+  bool overloaded() const;
+
+  // loop线程绑定的cpu及其NUMA节点，未绑核时为-1
+  int cpu() const { return cpu_; }
+  int numaNode() const { return numaNode_; }
+  // 为true时连接的缓冲区在本loop线程中分配，落在本NUMA节点上
+  bool numaLocalMemory() const { return numaLocalMemory_; }
+  void setPlacement(int cpu, int numaNode, bool numaLocalMemory)
+  {
+    cpu_ = cpu;
+    numaNode_ = numaNode;
+    numaLocalMemory_ = numaLocalMemory;
+  }
 
 private:
   void handleRead();        // 唤醒
-  void doPendingFunctors(); // 执行回调
+  size_t doPendingFunctors(int64_t slowNs); // 执行回调，返回执行的个数，slowNs>0时检查单个回调耗时
+  void drainSendRings();
+  int64_t addTimer(double interval, Functor cb, bool repeat);
+  void addTimerInLoop(int64_t timerId, int timerfd, Functor cb, bool repeat);
+  void cancelInLoop(int64_t timerId);
+  bool timerCancelled(int64_t timerId);
 
   using ChannelList = std::vector<Channel *>;
   std::atomic_bool looping_; // 原子操作，底层通过CAS实现
@@ -67,4 +166,44 @@ private:
   std::atomic_bool callingPendingFunctors_; // 标识当前loop是否有需要执行的回调操作
   std::vector<Functor> pendingFunctors_;    // 存储loop需要执行的所有回调操作
   std::mutex mutex_;                        // 互斥锁用来保护上面vector的线程安全操作
+  std::atomic<size_t> pendingFunctorCount_; // pendingFunctors_.size()，不加锁读
+  std::atomic<TcpConnection *> sendRings_;  // 待发送列表，用TcpConnection::nextSendRing串起来的无锁栈
+  std::atomic_bool polling_;                // 正在(或即将)阻塞在poll里
+
+  std::atomic_int connectionCount_;   // 当前loop管理的连接数
+  std::atomic<int64_t> pendingBytes_; // 当前loop所有连接outputBuffer中待发送的字节数
+
+  // 过载上限，0表示不检查
+  std::atomic_int maxConnections_;
+  std::atomic<size_t> maxPendingFunctors_;
+  std::atomic<int64_t> maxPendingBytes_;
+
+  int cpu_;
+  int numaNode_;
+  bool numaLocalMemory_;
+
+  clockid_t cpuClock_;                                // loop线程的cpu时钟
+
+  // 运行指标，只有loop线程写
+  std::atomic<uint64_t> wakeups_;
+  Histogram pollWaitHist_;
+  Histogram channelHist_;
+  Histogram functorHist_;
+  Histogram pendingFunctorsHist_;
+  Histogram activeChannelsHist_;
+  Histogram socketQueueHist_;
+  Histogram dispatchDelayHist_;
+  std::atomic<int64_t> nextTimerId_;
+  std::map<int64_t, std::unique_ptr<Channel>> timers_; // 定时器id => timerfd的channel
+  std::mutex timerMutex_;
+  std::set<int64_t> cancelledTimers_; // 已经cancel、还没在loop线程里清理的定时器
+  std::unique_ptr<TrafficShaper> trafficShaper_;
+  MemoryBudget memoryBudget_;
+  std::unique_ptr<MemoryGovernor> memoryGovernor_;
+
+  // 卡顿检测
+  std::atomic<int64_t> slowCallbackNs_;
+  std::atomic<int64_t> busySinceNs_;
+  std::atomic_int currentFd_;
+  std::atomic<const std::type_info *> currentFunctor_;
 };
\ No newline at end of file
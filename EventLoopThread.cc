@@ -1,14 +1,20 @@
 #include "EventLoopThread.h"
 #include "EventLoop.h"
+#include "CpuTopology.h"
 
 EventLoopThread::EventLoopThread(const ThreadInitCallback &cb,
-                                 const std::string &name)
+                                 const std::string &name,
+                                 const ThreadExitCallback &exitCb)
     : loop_(nullptr),
+      startedLoop_(nullptr),
       exiting_(false),
       thread_(std::bind(&EventLoopThread::threadFunc, this), name),
       mutex_(),
       cond_(),
-      callback_(cb)
+      callback_(cb),
+      exitCallback_(exitCb),
+      cpu_(-1),
+      numaLocalMemory_(false)
 {
 }
 
@@ -22,6 +28,16 @@ EventLoopThread::~EventLoopThread()
   }
 }
 
+void EventLoopThread::setPlacement(int cpu, bool numaLocalMemory)
+{
+  cpu_ = cpu;
+  numaLocalMemory_ = numaLocalMemory;
+  if (cpu_ >= 0)
+  {
+    thread_.setCpuAffinity(std::vector<int>(1, cpu_));
+  }
+}
+
 EventLoop *EventLoopThread::startLoop()
 {
   thread_.start(); // 启动底层的新线程
@@ -34,13 +50,25 @@ EventLoop *EventLoopThread::startLoop()
     }
     loop = loop_;
   }
+  startedLoop_ = loop;
   return loop;
 }
 
 // 下面的方法是在单独的新线程里面运行的
 void EventLoopThread::threadFunc()
 {
+  int node = -1;
+  if (cpu_ >= 0)
+  {
+    node = CpuTopology::numaNodeOfCpu(cpu_);
+    if (numaLocalMemory_)
+    {
+      CpuTopology::preferMemoryNode(node); // 先设置内存策略，EventLoop自身的内存也落在本节点
+    }
+  }
+
   EventLoop loop; // 创建一个独立的EventLoop,和上面的线程是一一对应的，one loop per thread
+  loop.setPlacement(cpu_, node, numaLocalMemory_);
 
   if (callback_)
   {
@@ -55,6 +83,11 @@ void EventLoopThread::threadFunc()
 
   loop.loop(); // 开启底层poller.poll
 
+  if (exitCallback_)
+  {
+    exitCallback_(&loop);
+  }
+
   // loop返回后
   std::unique_lock<std::mutex> lock(mutex_);
   loop_ = nullptr;
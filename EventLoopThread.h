@@ -14,21 +14,33 @@ class EventLoopThread : noncopyable
 {
 public:
   using ThreadInitCallback = std::function<void(EventLoop *)>;
+  // loop退出之后、析构之前在loop线程中回调，用来撤掉对该loop的引用(例如LoopWatchdog::unwatch)
+  using ThreadExitCallback = std::function<void(EventLoop *)>;
 
   EventLoopThread(const ThreadInitCallback &cb = ThreadInitCallback(),
-                  const std::string &name = std::string());
+                  const std::string &name = std::string(),
+                  const ThreadExitCallback &exitCb = ThreadExitCallback());
 
   ~EventLoopThread();
 
   EventLoop *startLoop();
+  // startLoop之后、线程结束之前有效
+  EventLoop *loop() const { return startedLoop_; }
+
+  // startLoop之前调用，把loop线程绑定到cpu上，numaLocalMemory为true时内存优先从该cpu的NUMA节点分配
+  void setPlacement(int cpu, bool numaLocalMemory);
 
 private:
   void threadFunc();
 
   EventLoop *loop_;
+  EventLoop *startedLoop_; // 只在调用startLoop的线程中读写
   bool exiting_;
   Thread thread_;
   std::mutex mutex_;
   std::condition_variable cond_;
   ThreadInitCallback callback_;
+  ThreadExitCallback exitCallback_;
+  int cpu_;
+  bool numaLocalMemory_;
 };
\ No newline at end of file
@@ -1,26 +1,33 @@
 #include "EventLoopThreadPool.h"
+#include "EventLoop.h"
+#include "InetAddress.h"
+#include "CpuTopology.h"
 
 EventLoopThreadPool::EventLoopThreadPool(EventLoop *baseloop, const std::string &nameArg)
     : baseloop_(baseloop),
       name_(nameArg),
       started_(false),
       numThreads_(0),
-      next_(0)
+      balancer_(LoadBalancer::newLoadBalancer(LoadBalancer::kRoundRobin)),
+      numaLocalMemory_(false),
+      nextIndex_(0)
 {
 }
 
 EventLoopThreadPool::~EventLoopThreadPool() {} // 每个线程的loop都是局部变量栈上对象，出作用域自动销毁。
 
-void EventLoopThreadPool::start(const ThreadInitCallback &cb)
+void EventLoopThreadPool::start(const ThreadInitCallback &cb, const ThreadExitCallback &exitCb)
 {
   started_ = true;
+  threadInitCallback_ = cb;
+  threadExitCallback_ = exitCb;
   for (int i = 0; i < numThreads_; ++i)
   {
-    char buf[name_.size() + 32];
-    snprintf(buf, sizeof buf, "%s%d", name_.c_str(), i);
-    EventLoopThread *t = new EventLoopThread(cb, buf);
+    EventLoopThread *t = newThread(nextIndex_++);
+    EventLoop *loop = t->startLoop(); // 底层创建线程，绑定一个新的Eventloop并返回该loop地址
+    std::unique_lock<std::mutex> lock(mutex_);
     threads_.push_back(std::unique_ptr<EventLoopThread>(t));
-    loops_.push_back(t->startLoop()); // 底层创建线程，绑定一个新的Eventloop并返回该loop地址
+    loops_.push_back(loop);
   }
 
   // 只有baseloop_
@@ -30,26 +37,153 @@ void EventLoopThreadPool::start(const ThreadInitCallback &cb)
   }
 }
 
-// 如果工作在多线程中，baseLoop_默认以轮询的方式分配channel给subloop
-EventLoop *EventLoopThreadPool::getNextLoop()
+EventLoopThread *EventLoopThreadPool::newThread(int index)
 {
-  EventLoop *loop = baseloop_;
-  // 轮询方式获取下一个处理事件的loop
+  char buf[name_.size() + 32];
+  snprintf(buf, sizeof buf, "%s%d", name_.c_str(), index);
+  EventLoopThread *t = new EventLoopThread(threadInitCallback_, buf, threadExitCallback_);
+  if (!cpus_.empty())
+  {
+    t->setPlacement(cpus_[index % cpus_.size()], numaLocalMemory_);
+  }
+  return t;
+}
+
+EventLoop *EventLoopThreadPool::addLoop()
+{
+  EventLoopThread *t = newThread(nextIndex_++);
+  EventLoop *loop = t->startLoop();
+  std::unique_lock<std::mutex> lock(mutex_);
+  threads_.push_back(std::unique_ptr<EventLoopThread>(t));
+  loops_.push_back(loop); // 下一个新连接就可能分配到这个loop上
+  ++numThreads_;
+  return loop;
+}
+
+EventLoop *EventLoopThreadPool::removeLoop()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
   if (loops_.empty())
   {
-    loop = loops_[next_];
-    ++next_;
-    if (next_ >= loops_.size())
+    return nullptr;
+  }
+  EventLoop *loop = loops_.back();
+  loops_.pop_back();
+  retiring_.push_back(std::move(threads_.back()));
+  threads_.pop_back();
+  --numThreads_;
+  return loop;
+}
+
+void EventLoopThreadPool::retireLoop(EventLoop *loop)
+{
+  std::unique_ptr<EventLoopThread> thread;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (auto it = retiring_.begin(); it != retiring_.end(); ++it)
     {
-      next_ = 0;
+      if ((*it)->loop() == loop)
+      {
+        thread = std::move(*it);
+        retiring_.erase(it);
+        break;
+      }
     }
   }
+  // 析构时quit并join该loop线程
+  thread.reset();
+}
+
+void EventLoopThreadPool::setOnePerPhysicalCore()
+{
+  cpus_ = CpuTopology::physicalCores();
+  numThreads_ = static_cast<int>(cpus_.size());
+}
+
+// 如果工作在多线程中，baseLoop_按选择策略分配channel给subloop
+EventLoop *EventLoopThreadPool::getNextLoop()
+{
+  return getNextLoop(InetAddress());
+}
+
+EventLoop *EventLoopThreadPool::getNextLoop(const InetAddress &peerAddr)
+{
+  EventLoop *loop = baseloop_;
+  // 没有subloop时所有连接都由baseloop处理
+  if (!loops_.empty())
+  {
+    loop = balancer_->select(loops_, peerAddr);
+  }
 
   return loop;
 }
 
+EventLoop *EventLoopThreadPool::getLoopForCpu(int cpu, int *distance)
+{
+  if (cpu < 0)
+  {
+    return nullptr;
+  }
+  const CpuPlace target = placeOf(cpu);
+  EventLoop *best = nullptr;
+  int bestDistance = 3;
+  for (EventLoop *loop : loops_)
+  {
+    if (loop->cpu() < 0)
+    {
+      continue;
+    }
+    int d = 3;
+    if (loop->cpu() == cpu)
+    {
+      d = 0;
+    }
+    else
+    {
+      const CpuPlace &place = placeOf(loop->cpu());
+      if (place.core >= 0 && place.package == target.package && place.core == target.core)
+      {
+        d = 1;
+      }
+      else if (place.node == target.node)
+      {
+        d = 2;
+      }
+    }
+    // 同一档次里选连接数少的
+    if (d < bestDistance || (d == bestDistance && best != nullptr && loop->connectionCount() < best->connectionCount()))
+    {
+      best = loop;
+      bestDistance = d;
+    }
+  }
+  if (best != nullptr && distance != nullptr)
+  {
+    *distance = bestDistance;
+  }
+  return best;
+}
+
+const EventLoopThreadPool::CpuPlace &EventLoopThreadPool::placeOf(int cpu)
+{
+  if (cpu >= static_cast<int>(cpuPlaces_.size()))
+  {
+    size_t old = cpuPlaces_.size();
+    cpuPlaces_.resize(cpu + 1);
+    for (size_t i = old; i < cpuPlaces_.size(); ++i)
+    {
+      int c = static_cast<int>(i);
+      cpuPlaces_[i].package = CpuTopology::packageIdOfCpu(c);
+      cpuPlaces_[i].core = CpuTopology::coreIdOfCpu(c);
+      cpuPlaces_[i].node = CpuTopology::numaNodeOfCpu(c);
+    }
+  }
+  return cpuPlaces_[cpu];
+}
+
 std::vector<EventLoop *> EventLoopThreadPool::getAllLoops()
 {
+  std::unique_lock<std::mutex> lock(mutex_);
   if (loops_.empty())
   {
     return std::vector<EventLoop *>(1, baseloop_);
@@ -58,4 +192,33 @@ std::vector<EventLoop *> EventLoopThreadPool::getAllLoops()
   {
     return loops_;
   }
-}
\ No newline at end of file
+}
+
+void EventLoopThreadPool::forEachLoop(const std::function<void(EventLoop *, size_t)> &cb)
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (loops_.empty())
+  {
+    cb(baseloop_, 0);
+  }
+  for (size_t i = 0; i < loops_.size(); ++i)
+  {
+    cb(loops_[i], i);
+  }
+}
+
+LoopMetrics EventLoopThreadPool::metrics()
+{
+  // 持锁期间loop不会被retire，读指标时loop对象一定还在
+  std::unique_lock<std::mutex> lock(mutex_);
+  LoopMetrics total;
+  if (loops_.empty())
+  {
+    total.merge(baseloop_->metrics());
+  }
+  for (EventLoop *loop : loops_)
+  {
+    total.merge(loop->metrics());
+  }
+  return total;
+}
@@ -2,41 +2,94 @@
 
 #include "noncopyable.h"
 #include "EventLoopThread.h"
+#include "LoadBalancer.h"
+#include "LoopMetrics.h"
 
 #include <functional>
 #include <string>
 #include <vector>
 #include <memory>
+#include <mutex>
 
 class EventLoop;
+class InetAddress;
 
 class EventLoopThreadPool : noncopyable
 {
 public:
   using ThreadInitCallback = std::function<void(EventLoop *)>;
+  using ThreadExitCallback = std::function<void(EventLoop *)>;
 
   EventLoopThreadPool(EventLoop *baseloop, const std::string &nameArg);
   ~EventLoopThreadPool();
 
   void setThreadNum(int numThreads) { numThreads_ = numThreads; }
 
-  void start(const ThreadInitCallback &cb = ThreadInitCallback());
+  // start之前设置，第i个subloop绑定到cpus[i % cpus.size()]
+  void setCpuAffinity(const std::vector<int> &cpus) { cpus_ = cpus; }
+  // start之前设置，每个物理核一个subloop
+  void setOnePerPhysicalCore();
+  // start之前设置，连接缓冲区分配在各自subloop所在的NUMA节点上，需配合绑核使用
+  void setNumaLocalMemory(bool on) { numaLocalMemory_ = on; }
 
-  // 如果工作在多线程中，baseLoop_默认以轮询的方式分配channel给subloop
+  // cb在每个subloop线程启动时回调(没有subloop时对baseloop回调一次)，
+  // exitCb在每个subloop退出、析构之前回调，包括运行时removeLoop退役的；baseloop归用户所有，不回调exitCb
+  void start(const ThreadInitCallback &cb = ThreadInitCallback(),
+             const ThreadExitCallback &exitCb = ThreadExitCallback());
+
+  // 设置subloop的选择策略，默认轮询
+  void setLoadBalancer(LoadBalancer::Strategy strategy) { balancer_.reset(LoadBalancer::newLoadBalancer(strategy)); }
+
+  // 如果工作在多线程中，baseLoop_按选择策略分配channel给subloop
   EventLoop *getNextLoop();
+  EventLoop *getNextLoop(const InetAddress &peerAddr);
+
+  // 找绑定在cpu上的subloop，找不到时依次退而求其次找同一物理核、同一NUMA节点上的subloop
+  // distance返回匹配程度：0同一cpu，1同一物理核，2同一NUMA节点；都没有时返回nullptr
+  EventLoop *getLoopForCpu(int cpu, int *distance);
 
+  // 运行时增减subloop，只能在baseloop线程中调用
+  // removeLoop只把最后一个subloop从分配列表中摘下，其上的连接迁走之后再调用retireLoop结束该线程
+  EventLoop *addLoop();
+  EventLoop *removeLoop();
+  void retireLoop(EventLoop *loop);
+
+  // 可在任意线程调用
   std::vector<EventLoop *> getAllLoops();
+  // 合并getAllLoops()中所有loop的运行指标，可在任意线程调用
+  LoopMetrics metrics();
+  // 持锁对getAllLoops()中的每个loop调用cb(loop, 序号)，可在任意线程调用
+  // cb里向该loop投递的任务一定会执行：持锁期间loop不会析构，随后被retire的loop退出前也会执行完队列里的任务
+  // cb在持锁时调用，只能queueInLoop，不能用runInLoop就地执行
+  void forEachLoop(const std::function<void(EventLoop *, size_t)> &cb);
 
   bool started() const { return started_; }
 
   const std::string &name() const { return name_; }
 
 private:
+  struct CpuPlace
+  {
+    int package;
+    int core;
+    int node;
+  };
+  const CpuPlace &placeOf(int cpu);
+  EventLoopThread *newThread(int index);
+
   EventLoop *baseloop_; // 用户最开始的EventLoop loop;
   std::string name_;
   bool started_;
   int numThreads_;
-  int next_;
+  std::unique_ptr<LoadBalancer> balancer_;
+  std::vector<int> cpus_;
+  bool numaLocalMemory_;
+  ThreadInitCallback threadInitCallback_;
+  ThreadExitCallback threadExitCallback_;
+  int nextIndex_; // 线程名编号
   std::vector<std::unique_ptr<EventLoopThread>> threads_;
-  std::vector<EventLoop *> loops_;
+  std::vector<std::unique_ptr<EventLoopThread>> retiring_; // 已摘下等待结束的线程
+  std::vector<EventLoop *> loops_;                          // baseloop线程写，写时加锁
+  std::mutex mutex_;
+  std::vector<CpuPlace> cpuPlaces_; // 按cpu编号缓存拓扑，只在baseloop线程访问
 };
\ No newline at end of file
@@ -0,0 +1,179 @@
+#include "Handoff.h"
+#include "Logger.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+namespace
+{
+  bool fillAddr(const std::string &path, sockaddr_un *addr)
+  {
+    memset(addr, 0, sizeof *addr);
+    addr->sun_family = AF_UNIX;
+    if (path.size() >= sizeof addr->sun_path)
+    {
+      LOG_ERROR("handoff path too long:%s \n", path.c_str());
+      return false;
+    }
+    strncpy(addr->sun_path, path.c_str(), sizeof addr->sun_path - 1);
+    return true;
+  }
+
+  // "1.2.3.4:80" => InetAddress
+  InetAddress parseIpPort(const std::string &text)
+  {
+    size_t colon = text.rfind(':');
+    if (colon == std::string::npos)
+    {
+      return InetAddress();
+    }
+    return InetAddress(static_cast<uint16_t>(atoi(text.c_str() + colon + 1)), text.substr(0, colon));
+  }
+}
+
+namespace Handoff
+{
+  int listenOn(const std::string &path)
+  {
+    sockaddr_un addr;
+    if (!fillAddr(path, &addr))
+    {
+      return -1;
+    }
+    int fd = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    ::unlink(path.c_str());
+    if (fd < 0 || ::bind(fd, (sockaddr *)&addr, sizeof addr) < 0 || ::listen(fd, 4) < 0)
+    {
+      LOG_ERROR("handoff listen on %s err:%d \n", path.c_str(), errno);
+      if (fd >= 0)
+      {
+        ::close(fd);
+      }
+      return -1;
+    }
+    return fd;
+  }
+
+  bool sendFd(int unixfd, char type, const std::string &text, int fd)
+  {
+    std::string msg(1, type);
+    msg += text;
+    iovec iov;
+    iov.iov_base = &msg[0];
+    iov.iov_len = msg.size();
+
+    msghdr hdr;
+    memset(&hdr, 0, sizeof hdr);
+    hdr.msg_iov = &iov;
+    hdr.msg_iovlen = 1;
+
+    char control[CMSG_SPACE(sizeof(int))];
+    if (fd >= 0)
+    {
+      memset(control, 0, sizeof control);
+      hdr.msg_control = control;
+      hdr.msg_controllen = sizeof control;
+      cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr);
+      cmsg->cmsg_level = SOL_SOCKET;
+      cmsg->cmsg_type = SCM_RIGHTS;
+      cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+      memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    }
+
+    ssize_t n;
+    do
+    {
+      n = ::sendmsg(unixfd, &hdr, MSG_NOSIGNAL);
+    } while (n < 0 && errno == EINTR);
+    if (n != static_cast<ssize_t>(msg.size()))
+    {
+      LOG_ERROR("handoff sendmsg err:%d \n", errno);
+      return false;
+    }
+    return true;
+  }
+
+  bool recvFd(int unixfd, char *type, std::string *text, int *fd)
+  {
+    char buf[256];
+    iovec iov;
+    iov.iov_base = buf;
+    iov.iov_len = sizeof buf;
+
+    char control[CMSG_SPACE(sizeof(int))];
+    msghdr hdr;
+    memset(&hdr, 0, sizeof hdr);
+    hdr.msg_iov = &iov;
+    hdr.msg_iovlen = 1;
+    hdr.msg_control = control;
+    hdr.msg_controllen = sizeof control;
+
+    ssize_t n;
+    do
+    {
+      n = ::recvmsg(unixfd, &hdr, MSG_CMSG_CLOEXEC);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0)
+    {
+      return false;
+    }
+
+    *fd = -1;
+    for (cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr); cmsg != nullptr; cmsg = CMSG_NXTHDR(&hdr, cmsg))
+    {
+      if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+      {
+        memcpy(fd, CMSG_DATA(cmsg), sizeof(int));
+      }
+    }
+    *type = buf[0];
+    text->assign(buf + 1, n - 1);
+    return true;
+  }
+
+  bool takeOver(const std::string &path, Inherited *inherited)
+  {
+    inherited->listenFd = -1;
+    inherited->connections.clear();
+
+    sockaddr_un addr;
+    if (!fillAddr(path, &addr))
+    {
+      return false;
+    }
+    int unixfd = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (unixfd < 0 || ::connect(unixfd, (sockaddr *)&addr, sizeof addr) < 0)
+    {
+      if (unixfd >= 0)
+      {
+        ::close(unixfd);
+      }
+      return false; // 没有旧进程在等待交接
+    }
+
+    char type = 0;
+    std::string text;
+    int fd = -1;
+    while (recvFd(unixfd, &type, &text, &fd) && type != 'E')
+    {
+      if (type == 'L' && fd >= 0)
+      {
+        inherited->listenFd = fd;
+      }
+      else if (type == 'C' && fd >= 0)
+      {
+        inherited->connections.push_back(std::make_pair(fd, parseIpPort(text)));
+      }
+      else if (fd >= 0)
+      {
+        ::close(fd);
+      }
+    }
+    ::close(unixfd);
+    return inherited->listenFd >= 0;
+  }
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "InetAddress.h"
+
+#include <string>
+#include <vector>
+#include <utility>
+
+/**
+ * 不停机重启：旧进程通过unix域socket(SOCK_SEQPACKET)用SCM_RIGHTS把监听fd和空闲连接fd交给新进程。
+ * 每条消息是一个类型字节加文本，最多带一个fd：
+ *   'L' 监听socket   'C' 已建立的连接，文本为对端ip:port   'E' 传递结束
+ */
+namespace Handoff
+{
+  struct Inherited
+  {
+    int listenFd;
+    std::vector<std::pair<int, InetAddress>> connections;
+  };
+
+  // 新进程调用：连接旧进程在path上的监听，收取所有fd。没有旧进程时返回false
+  bool takeOver(const std::string &path, Inherited *inherited);
+
+  // 创建监听在path上的unix域socket，供旧进程等待新进程连接
+  int listenOn(const std::string &path);
+
+  bool sendFd(int unixfd, char type, const std::string &text, int fd);
+  // 没有附带fd时*fd为-1
+  bool recvFd(int unixfd, char *type, std::string *text, int *fd);
+}
@@ -0,0 +1,78 @@
+#include "Histogram.h"
+
+Histogram::Histogram() : count_(0), sum_(0), max_(0)
+{
+  for (std::atomic<uint64_t> &bucket : counts_)
+  {
+    bucket.store(0, std::memory_order_relaxed);
+  }
+}
+
+Histogram::Snapshot Histogram::snapshot() const
+{
+  Snapshot snap;
+  for (int i = 0; i < kNumBuckets; ++i)
+  {
+    snap.counts[i] = counts_[i].load(std::memory_order_relaxed);
+  }
+  snap.count = count_.load(std::memory_order_relaxed);
+  snap.sum = sum_.load(std::memory_order_relaxed);
+  snap.max = max_.load(std::memory_order_relaxed);
+  return snap;
+}
+
+uint64_t Histogram::bucketUpperBound(int bucket)
+{
+  if (bucket < (1 << kSubBucketBits))
+  {
+    return static_cast<uint64_t>(bucket);
+  }
+  int shift = (bucket >> kSubBucketBits) - 1;
+  uint64_t sub = static_cast<uint64_t>(bucket & ((1 << kSubBucketBits) - 1));
+  uint64_t lower = ((1ull << kSubBucketBits) + sub) << shift;
+  return lower + (1ull << shift) - 1;
+}
+
+void Histogram::Snapshot::merge(const Snapshot &other)
+{
+  for (int i = 0; i < kNumBuckets; ++i)
+  {
+    counts[i] += other.counts[i];
+  }
+  count += other.count;
+  sum += other.sum;
+  if (other.max > max)
+  {
+    max = other.max;
+  }
+}
+
+uint64_t Histogram::Snapshot::percentile(double p) const
+{
+  // 各桶计数和count分开读，以桶的总和为准
+  uint64_t total = 0;
+  for (uint64_t c : counts)
+  {
+    total += c;
+  }
+  if (total == 0)
+  {
+    return 0;
+  }
+  uint64_t rank = static_cast<uint64_t>(p / 100.0 * total + 0.5);
+  if (rank < 1)
+  {
+    rank = 1;
+  }
+  uint64_t seen = 0;
+  for (int i = 0; i < kNumBuckets; ++i)
+  {
+    seen += counts[i];
+    if (seen >= rank)
+    {
+      uint64_t bound = bucketUpperBound(i);
+      return bound < max ? bound : max;
+    }
+  }
+  return max;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <atomic>
+#include <vector>
+#include <stdint.h>
+
+/**
+ * 对数线性直方图：每个2的幂区间再等分成8个桶，相对误差不超过12.5%，
+ * 覆盖[0, 2^41)，更大的值计入最后一个桶。用来记录纳秒耗时、队列长度等。
+ * 只允许一个线程record（通常是所属loop线程），不加锁；任意线程可以snapshot，读到的是近似一致的值。
+ */
+class Histogram : noncopyable
+{
+public:
+  static const int kSubBucketBits = 3;
+  static const int kMaxExponent = 40;
+  static const int kNumBuckets = (kMaxExponent - kSubBucketBits + 2) << kSubBucketBits;
+
+  // 普通值的拷贝，可以合并多个直方图
+  struct Snapshot
+  {
+    Snapshot() : counts(kNumBuckets, 0), count(0), sum(0), max(0) {}
+
+    void merge(const Snapshot &other);
+    // p取[0,100]，返回所在桶的上界，不超过max
+    uint64_t percentile(double p) const;
+    double mean() const { return count == 0 ? 0 : static_cast<double>(sum) / count; }
+
+    std::vector<uint64_t> counts;
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+  };
+
+  Histogram();
+
+  void record(uint64_t value)
+  {
+    std::atomic<uint64_t> &bucket = counts_[bucketOf(value)];
+    bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    count_.store(count_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    sum_.store(sum_.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    if (value > max_.load(std::memory_order_relaxed))
+    {
+      max_.store(value, std::memory_order_relaxed);
+    }
+  }
+
+  Snapshot snapshot() const;
+
+  static int bucketOf(uint64_t value)
+  {
+    if (value < (1u << kSubBucketBits))
+    {
+      return static_cast<int>(value);
+    }
+    int exponent = 63 - __builtin_clzll(value);
+    if (exponent > kMaxExponent)
+    {
+      return kNumBuckets - 1;
+    }
+    int shift = exponent - kSubBucketBits;
+    return ((shift + 1) << kSubBucketBits) + static_cast<int>((value >> shift) & ((1u << kSubBucketBits) - 1));
+  }
+  // 桶内最大的值
+  static uint64_t bucketUpperBound(int bucket);
+
+private:
+  std::atomic<uint64_t> counts_[kNumBuckets];
+  std::atomic<uint64_t> count_;
+  std::atomic<uint64_t> sum_;
+  std::atomic<uint64_t> max_;
+};
@@ -0,0 +1,159 @@
+#include "LoadBalancer.h"
+#include "EventLoop.h"
+#include "InetAddress.h"
+
+#include <algorithm>
+#include <random>
+#include <utility>
+
+namespace
+{
+  // 轮询
+  class RoundRobinBalancer : public LoadBalancer
+  {
+  public:
+    RoundRobinBalancer() : next_(0) {}
+
+    EventLoop *select(const std::vector<EventLoop *> &loops, const InetAddress &) override
+    {
+      if (next_ >= loops.size()) // loop数量可能在运行时变化
+      {
+        next_ = 0;
+      }
+      return loops[next_++];
+    }
+
+  private:
+    size_t next_;
+  };
+
+  // 连接数最少的loop，相同时取靠前的
+  class LeastConnectionsBalancer : public LoadBalancer
+  {
+  public:
+    EventLoop *select(const std::vector<EventLoop *> &loops, const InetAddress &) override
+    {
+      return *std::min_element(loops.begin(), loops.end(),
+                               [](EventLoop *a, EventLoop *b)
+                               { return a->connectionCount() < b->connectionCount(); });
+    }
+  };
+
+  // 发送缓冲区积压最少的loop，积压相同再比较连接数
+  class LeastPendingBytesBalancer : public LoadBalancer
+  {
+  public:
+    EventLoop *select(const std::vector<EventLoop *> &loops, const InetAddress &) override
+    {
+      return *std::min_element(loops.begin(), loops.end(),
+                               [](EventLoop *a, EventLoop *b)
+                               {
+                                 int64_t pa = a->pendingBytes();
+                                 int64_t pb = b->pendingBytes();
+                                 return pa < pb || (pa == pb && a->connectionCount() < b->connectionCount());
+                               });
+    }
+  };
+
+  // power of two choices：只读两个loop的计数器，负载接近最优且不会所有新连接都扎堆同一个loop
+  class PowerOfTwoChoicesBalancer : public LoadBalancer
+  {
+  public:
+    PowerOfTwoChoicesBalancer() : rng_(std::random_device()()) {}
+
+    EventLoop *select(const std::vector<EventLoop *> &loops, const InetAddress &) override
+    {
+      if (loops.size() == 1)
+      {
+        return loops[0];
+      }
+      size_t i = rng_() % loops.size();
+      size_t j = rng_() % (loops.size() - 1);
+      if (j >= i)
+      {
+        ++j; // 保证两次选择不同
+      }
+      EventLoop *a = loops[i];
+      EventLoop *b = loops[j];
+      if (a->connectionCount() != b->connectionCount())
+      {
+        return a->connectionCount() < b->connectionCount() ? a : b;
+      }
+      return a->pendingBytes() <= b->pendingBytes() ? a : b;
+    }
+
+  private:
+    std::minstd_rand rng_;
+  };
+
+  // 一致性哈希，每个loop在环上放kVirtualNodes个虚拟节点，loop增减时只有少量客户端换loop
+  class ConsistentHashBalancer : public LoadBalancer
+  {
+  public:
+    EventLoop *select(const std::vector<EventLoop *> &loops, const InetAddress &peerAddr) override
+    {
+      if (loops != loops_)
+      {
+        rebuild(loops);
+      }
+      uint32_t h = mix(peerAddr.getSockAddr()->sin_addr.s_addr);
+      auto it = std::lower_bound(ring_.begin(), ring_.end(), std::make_pair(h, size_t(0)));
+      if (it == ring_.end())
+      {
+        it = ring_.begin();
+      }
+      return loops_[it->second];
+    }
+
+  private:
+    static const int kVirtualNodes = 64;
+
+    // murmur3的finalizer，把ip打散到整个32位空间
+    static uint32_t mix(uint32_t h)
+    {
+      h ^= h >> 16;
+      h *= 0x85ebca6b;
+      h ^= h >> 13;
+      h *= 0xc2b2ae35;
+      h ^= h >> 16;
+      return h;
+    }
+
+    void rebuild(const std::vector<EventLoop *> &loops)
+    {
+      loops_ = loops;
+      ring_.clear();
+      ring_.reserve(loops.size() * kVirtualNodes);
+      for (size_t i = 0; i < loops.size(); ++i)
+      {
+        for (int v = 0; v < kVirtualNodes; ++v)
+        {
+          // 虚拟节点只和loop下标有关，新增loop时已有节点位置不变
+          ring_.push_back(std::make_pair(mix(static_cast<uint32_t>(i * kVirtualNodes + v) * 0x9e3779b1u), i));
+        }
+      }
+      std::sort(ring_.begin(), ring_.end());
+    }
+
+    std::vector<EventLoop *> loops_;
+    std::vector<std::pair<uint32_t, size_t>> ring_;
+  };
+}
+
+LoadBalancer *LoadBalancer::newLoadBalancer(Strategy strategy)
+{
+  switch (strategy)
+  {
+  case kLeastConnections:
+    return new LeastConnectionsBalancer;
+  case kLeastPendingBytes:
+    return new LeastPendingBytesBalancer;
+  case kPowerOfTwoChoices:
+    return new PowerOfTwoChoicesBalancer;
+  case kConsistentHash:
+    return new ConsistentHashBalancer;
+  case kRoundRobin:
+  default:
+    return new RoundRobinBalancer;
+  }
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <vector>
+
+class EventLoop;
+class InetAddress;
+
+// subloop选择策略的抽象，由EventLoopThreadPool在baseloop线程中调用
+class LoadBalancer : noncopyable
+{
+public:
+  enum Strategy
+  {
+    kRoundRobin,        // 轮询
+    kLeastConnections,  // 连接数最少
+    kLeastPendingBytes, // 待发送字节数最少
+    kPowerOfTwoChoices, // 随机挑两个，选负载较小的
+    kConsistentHash,    // 按对端ip做一致性哈希，同一客户端总落在同一个loop
+  };
+
+  virtual ~LoadBalancer() = default;
+
+  // 从loops中选择一个loop，loops保证非空
+  virtual EventLoop *select(const std::vector<EventLoop *> &loops, const InetAddress &peerAddr) = 0;
+
+  static LoadBalancer *newLoadBalancer(Strategy strategy);
+};
@@ -0,0 +1,71 @@
+#include "LogFile.h"
+
+#include <unistd.h>
+
+LogFile::LogFile(const std::string &basename, off_t rollSize, int rollInterval)
+    : basename_(basename),
+      rollSize_(rollSize),
+      rollInterval_(rollInterval > 0 ? rollInterval : 60 * 60 * 24),
+      fp_(nullptr),
+      written_(0),
+      period_(0)
+{
+  rollFile(::time(nullptr));
+}
+
+LogFile::~LogFile()
+{
+  if (fp_ != nullptr)
+  {
+    ::fclose(fp_);
+  }
+}
+
+void LogFile::append(const char *data, size_t len)
+{
+  time_t now = ::time(nullptr);
+  if (written_ >= rollSize_ || now / rollInterval_ * rollInterval_ != period_)
+  {
+    rollFile(now);
+  }
+  if (fp_ != nullptr)
+  {
+    // 只有后台线程写这个文件，用不加锁的版本
+    written_ += ::fwrite_unlocked(data, 1, len, fp_);
+  }
+}
+
+void LogFile::flush()
+{
+  if (fp_ != nullptr)
+  {
+    ::fflush(fp_);
+  }
+}
+
+void LogFile::rollFile(time_t now)
+{
+  tm tm_time;
+  localtime_r(&now, &tm_time);
+  char timebuf[32] = {0};
+  strftime(timebuf, sizeof timebuf, ".%Y%m%d-%H%M%S.", &tm_time);
+
+  char pidbuf[32] = {0};
+  snprintf(pidbuf, sizeof pidbuf, "%d.log", ::getpid());
+
+  std::string filename = basename_ + timebuf + pidbuf;
+  FILE *fp = ::fopen(filename.c_str(), "ae");
+  if (fp == nullptr)
+  {
+    ::fprintf(stderr, "LogFile::rollFile open %s failed\n", filename.c_str());
+    return; // 打不开新文件时继续写旧文件
+  }
+  if (fp_ != nullptr)
+  {
+    ::fclose(fp_);
+  }
+  fp_ = fp;
+  ::setvbuf(fp_, buffer_, _IOFBF, sizeof buffer_);
+  written_ = 0;
+  period_ = now / rollInterval_ * rollInterval_;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <string>
+#include <stdio.h>
+#include <time.h>
+#include <sys/types.h>
+
+// 日志文件，写满rollSize字节或跨过rollInterval秒的整点边界时换一个新文件
+// 文件名: basename.YYYYmmdd-HHMMSS.pid.log，只由AsyncLogging的后台线程使用，不加锁
+class LogFile : noncopyable
+{
+public:
+  LogFile(const std::string &basename, off_t rollSize, int rollInterval = 60 * 60 * 24);
+  ~LogFile();
+
+  void append(const char *data, size_t len);
+  void flush();
+
+private:
+  void rollFile(time_t now);
+
+  const std::string basename_;
+  const off_t rollSize_;
+  const int rollInterval_;
+
+  FILE *fp_;
+  off_t written_;    // 当前文件已写入的字节数
+  time_t period_;    // 当前文件所属的时间段起点
+  char buffer_[64 * 1024];
+};
@@ -1,7 +1,10 @@
 #include "Logger.h"
 #include "Timestamp.h"
 
-#include <iostream>
+#include <stdio.h>
+
+std::atomic_int Logger::levels_[Logger::kNumModules] = {
+    {MYMUDUO_MIN_LOG_LEVEL}, {MYMUDUO_MIN_LOG_LEVEL}, {MYMUDUO_MIN_LOG_LEVEL}, {MYMUDUO_MIN_LOG_LEVEL}};
 
 Logger &Logger::instance()
 {
@@ -11,28 +14,68 @@ Logger &Logger::instance()
 
 void Logger::setLogLevel(int level)
 {
-  logLevel_ = level;
+  for (int i = 0; i < kNumModules; ++i)
+  {
+    levels_[i].store(level, std::memory_order_relaxed);
+  }
+}
+
+void Logger::setLogLevel(Module module, int level)
+{
+  levels_[module].store(level, std::memory_order_relaxed);
 }
 
-void Logger::log(std::string msg)
+void Logger::log(int level, const char *msg)
 {
-  switch (logLevel_)
+  const char *tag = "";
+  switch (level)
   {
   case INFO:
-    std::cout << "[INFO]";
+    tag = "[INFO]";
     break;
   case ERROR:
-    std::cout << "[ERROR]";
+    tag = "[ERROR]";
     break;
   case FATAL:
-    std::cout << "[FATAL]";
+    tag = "[FATAL]";
     break;
   case DEBUG:
-    std::cout << "[DEBUG]";
+    tag = "[DEBUG]";
+    break;
   default:
     break;
   }
 
-  std::cout << Timestamp::now().toString()
-            << ":" << msg << std::endl;
+  // 整行拼好后一次性输出，多线程写日志时行与行不会交错
+  std::string line(tag);
+  line += Timestamp::now().toFormattedString();
+  line += ":";
+  line += msg;
+  line += "\n";
+
+  append(line.data(), line.size());
+}
+
+void Logger::append(const char *line, size_t len)
+{
+  if (output_)
+  {
+    output_(line, len);
+  }
+  else
+  {
+    ::fwrite(line, 1, len, stdout);
+  }
+}
+
+void Logger::flush()
+{
+  if (flush_)
+  {
+    flush_();
+  }
+  else
+  {
+    ::fflush(stdout);
+  }
 }
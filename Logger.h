@@ -1,76 +1,146 @@
 #pragma once
 
 #include <string>
+#include <functional>
+#include <atomic>
+#include <stdio.h>
 
 #include "noncopyable.h"
 
-// 日志宏LOG_INFO("%s %d",arg1,arg2)
-#define LOG_INFO(logmsgFormat, ...)                   \
-  do                                                  \
-  {                                                   \
-    Logger &logger = Logger::instance();              \
-    logger.setLogLevel(INFO);                         \
-    char buf[1024] = {0};                             \
-    snprintf(buf, 1024, logmsgFormat, ##__VA_ARGS__); \
-    logger.log(buf);                                  \
-  } while (0)
+// 编译期最低日志级别，低于它的日志语句直接被预处理掉: 0 DEBUG 1 INFO 2 ERROR
+// 例如 -DMYMUDUO_MIN_LOG_LEVEL=2 只保留ERROR和FATAL
+#ifndef MYMUDUO_MIN_LOG_LEVEL
+#ifdef MUDEBUG
+#define MYMUDUO_MIN_LOG_LEVEL 0
+#else
+#define MYMUDUO_MIN_LOG_LEVEL 1
+#endif
+#endif
 
-#define LOG_ERROR(logmsgFormat, ...)                  \
-  do                                                  \
-  {                                                   \
-    Logger &logger = Logger::instance();              \
-    logger.setLogLevel(ERROR);                        \
-    char buf[1024] = {0};                             \
-    snprintf(buf, 1024, logmsgFormat, ##__VA_ARGS__); \
-    logger.log(buf);                                  \
-  } while (0)
+// 源文件在include之前定义LOG_MODULE，可让本文件的日志受该模块的级别控制
+#ifndef LOG_MODULE
+#define LOG_MODULE Logger::kDefault
+#endif
 
-#define LOG_FATAL(logmsgFormat, ...)                  \
-  do                                                  \
-  {                                                   \
-    Logger &logger = Logger::instance();              \
-    logger.setLogLevel(FATAL);                        \
-    char buf[1024] = {0};                             \
-    snprintf(buf, 1024, logmsgFormat, ##__VA_ARGS__); \
-    logger.log(buf);                                  \
-    exit(-1);                                         \
+#ifdef MYMUDUO_BINARY_LOG
+#include "BinaryLog.h"
+// 二进制模式：第一次执行时登记格式串，之后只拷贝参数，由后台线程格式化
+// if (false)里的snprintf不会执行，只为了让编译器继续检查格式串和参数
+#define LOG_AT(level, logmsgFormat, ...)                                           \
+  do                                                                               \
+  {                                                                                \
+    if (Logger::enabled(LOG_MODULE, level))                                        \
+    {                                                                              \
+      static const int logFormatId = BinaryLog::registerFormat(level, logmsgFormat); \
+      if (false)                                                                   \
+        snprintf(nullptr, 0, logmsgFormat, ##__VA_ARGS__);                         \
+      BinaryLog::log(logFormatId, ##__VA_ARGS__);                                  \
+    }                                                                              \
   } while (0)
+#define LOG_DRAIN() BinaryLog::stop()
+#else
+// 先用一次relaxed load判断级别，没开启时不格式化
+#define LOG_AT(level, logmsgFormat, ...)                      \
+  do                                                          \
+  {                                                           \
+    if (Logger::enabled(LOG_MODULE, level))                   \
+    {                                                         \
+      char buf[1024];                                         \
+      snprintf(buf, sizeof buf, logmsgFormat, ##__VA_ARGS__); \
+      Logger::instance().log(level, buf);                     \
+    }                                                         \
+  } while (0)
+#define LOG_DRAIN() \
+  do                \
+  {                 \
+  } while (0)
+#endif
 
-#ifdef MUDEBUG
-#define LOG_DEBUG(logmsgFormat, ...)                  \
-  do                                                  \
-  {                                                   \
-    Logger &logger = Logger::instance();              \
-    logger.setLogLevel(DEBUG);                        \
-    char buf[1024] = {0};                             \
-    snprintf(buf, 1024, logmsgFormat, ##__VA_ARGS__); \
-    logger.log(buf);                                  \
+// 日志宏LOG_INFO("%s %d",arg1,arg2)
+#if MYMUDUO_MIN_LOG_LEVEL <= 1
+#define LOG_INFO(logmsgFormat, ...) LOG_AT(INFO, logmsgFormat, ##__VA_ARGS__)
+#else
+#define LOG_INFO(logmsgFormat, ...) do {} while (0)
+#endif
+
+#if MYMUDUO_MIN_LOG_LEVEL <= 2
+#define LOG_ERROR(logmsgFormat, ...) LOG_AT(ERROR, logmsgFormat, ##__VA_ARGS__)
+#else
+#define LOG_ERROR(logmsgFormat, ...) do {} while (0)
+#endif
+
+// FATAL不受级别控制，二进制模式下先把之前的日志输出完
+#define LOG_FATAL(logmsgFormat, ...)                        \
+  do                                                        \
+  {                                                         \
+    Logger &logger = Logger::instance();                    \
+    char buf[1024];                                         \
+    snprintf(buf, sizeof buf, logmsgFormat, ##__VA_ARGS__); \
+    LOG_DRAIN();                                            \
+    logger.log(FATAL, buf);                                 \
+    logger.flush();                                         \
+    exit(-1);                                               \
   } while (0)
+
+#if MYMUDUO_MIN_LOG_LEVEL <= 0
+#define LOG_DEBUG(logmsgFormat, ...) LOG_AT(DEBUG, logmsgFormat, ##__VA_ARGS__)
 #else
-#define LOG_DEBUG(logmsgFormat, ...)
+#define LOG_DEBUG(logmsgFormat, ...) do {} while (0)
 #endif
 
-// 定义日志级别 INFO ERROR FATAL DEBAG
+// 定义日志级别 DEBUG INFO ERROR FATAL，按严重程度递增
 enum Loglevel
 {
+  DEBUG,
   INFO,
   ERROR,
   FATAL,
-  DEBUG,
-
 };
 
 // 输出一个日志类
 class Logger : noncopyable
 {
 public:
+  using OutputFunc = std::function<void(const char *msg, size_t len)>;
+  using FlushFunc = std::function<void()>;
+
+  // 可以单独调级别的模块，热路径上的逐事件日志归到前三个
+  enum Module
+  {
+    kDefault,
+    kPoller,
+    kChannel,
+    kConnection,
+    kNumModules,
+  };
+
   static Logger &instance();
-  // 设置日志级别
-  void setLogLevel(int level);
-  // 写日志
-  void log(std::string msg);
+  // 写日志，级别随每条日志传入，多个线程同时写日志互不干扰
+  void log(int level, const char *msg);
+  // 输出已经拼好的整行，BinaryLog的后台线程用它
+  void append(const char *line, size_t len);
+  void flush();
+
+  // 运行时级别，任何线程随时可改；默认INFO，定义MUDEBUG时为DEBUG
+  static bool enabled(Module module, int level)
+  {
+    return level >= levels_[module].load(std::memory_order_relaxed);
+  }
+  static void setLogLevel(int level);               // 设置所有模块
+  static void setLogLevel(Module module, int level); // 只设置一个模块
+  static int logLevel(Module module) { return levels_[module].load(std::memory_order_relaxed); }
+
+  // 替换日志的输出目的地，默认写到stdout，例如接到AsyncLogging::append上
+  // 两者替换std::function时不加锁，写日志的路径上也不加锁读，只能在其他线程开始写日志之前、
+  // 并且在它们全部停止之后设置；运行中途换输出会和正在写日志的线程产生数据竞争
+  void setOutput(OutputFunc out) { output_ = std::move(out); }
+  void setFlush(FlushFunc flush) { flush_ = std::move(flush); }
 
 private:
-  int logLevel_; // 日志级别
   Logger() {}
+
+  static std::atomic_int levels_[kNumModules];
+
+  OutputFunc output_;
+  FlushFunc flush_;
 };
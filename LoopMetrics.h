@@ -0,0 +1,42 @@
+#pragma once
+
+#include "Histogram.h"
+
+#include <stdint.h>
+
+// 一个或多个EventLoop的运行指标快照，耗时单位为纳秒
+struct LoopMetrics
+{
+  LoopMetrics() : loops(0), iterations(0), wakeups(0), channelEvents(0), functorsRun(0) {}
+
+  void merge(const LoopMetrics &other)
+  {
+    loops += other.loops;
+    iterations += other.iterations;
+    wakeups += other.wakeups;
+    channelEvents += other.channelEvents;
+    functorsRun += other.functorsRun;
+    pollWaitNs.merge(other.pollWaitNs);
+    channelNs.merge(other.channelNs);
+    functorNs.merge(other.functorNs);
+    pendingFunctors.merge(other.pendingFunctors);
+    activeChannels.merge(other.activeChannels);
+    socketQueueNs.merge(other.socketQueueNs);
+    dispatchDelayNs.merge(other.dispatchDelayNs);
+  }
+
+  int loops;              // 合并了几个loop
+  uint64_t iterations;    // 循环轮数
+  uint64_t wakeups;       // 被wakeup()唤醒的次数
+  uint64_t channelEvents; // 处理过的channel事件数
+  uint64_t functorsRun;   // 执行过的pending functor数
+
+  Histogram::Snapshot pollWaitNs;      // 每轮阻塞在poll里的时间
+  Histogram::Snapshot channelNs;       // 每轮处理channel事件的时间，没有事件的轮次不记
+  Histogram::Snapshot functorNs;       // 每轮doPendingFunctors的时间，队列为空的轮次不记
+  Histogram::Snapshot pendingFunctors; // 每轮取出的pending functor个数
+  Histogram::Snapshot activeChannels;  // 每轮poll返回的channel个数
+  // 以下只统计开启了接收时间戳的连接，每次读一个样本
+  Histogram::Snapshot socketQueueNs;   // 内核收到数据到poll返回，数据在socket里排队的时间
+  Histogram::Snapshot dispatchDelayNs; // poll返回到handleRead读出数据，排在同一轮其他channel后面的时间
+};
@@ -0,0 +1,227 @@
+#include "LoopWatchdog.h"
+#include "EventLoop.h"
+#include "Logger.h"
+#include "Timestamp.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cxxabi.h>
+#include <errno.h>
+#include <execinfo.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+
+namespace
+{
+  const int kMaxFrames = 64;
+
+  // 同一时刻只抓一个线程的栈
+  std::mutex g_captureMutex;
+  void *g_frames[kMaxFrames];
+  std::atomic_int g_depth(-1);
+
+  // 在被抓栈的loop线程里执行，只把返回地址存下来，符号化交给看门狗线程
+  void onBacktraceSignal(int)
+  {
+    int saveErrno = errno;
+    g_depth.store(::backtrace(g_frames, kMaxFrames), std::memory_order_release);
+    errno = saveErrno;
+  }
+
+  std::string demangle(const char *name)
+  {
+    int status = 0;
+    char *demangled = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+    if (status != 0 || demangled == nullptr)
+    {
+      return name;
+    }
+    std::string result(demangled);
+    ::free(demangled);
+    return result;
+  }
+}
+
+LoopWatchdog::LoopWatchdog(double stallThreshold, double checkInterval)
+    : stallNs_(static_cast<int64_t>(stallThreshold * 1e9)),
+      intervalNs_(static_cast<int64_t>((checkInterval > 0 ? checkInterval : stallThreshold / 4) * 1e9)),
+      captureBacktrace_(false),
+      running_(false),
+      thread_(std::bind(&LoopWatchdog::threadFunc, this), "LoopWatchdog")
+{
+}
+
+LoopWatchdog::~LoopWatchdog()
+{
+  if (running_)
+  {
+    stop();
+  }
+}
+
+void LoopWatchdog::watch(EventLoop *loop)
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  loops_.push_back(Watched{loop, 0});
+}
+
+void LoopWatchdog::unwatch(EventLoop *loop)
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  loops_.erase(std::remove_if(loops_.begin(), loops_.end(),
+                              [loop](const Watched &w)
+                              { return w.loop == loop; }),
+               loops_.end());
+}
+
+void LoopWatchdog::start()
+{
+  if (captureBacktrace_)
+  {
+    // backtrace第一次调用时会加载libgcc，先在这里调用一次，信号处理函数里就不会再分配内存
+    void *frame;
+    ::backtrace(&frame, 1);
+    struct sigaction sa;
+    ::memset(&sa, 0, sizeof sa);
+    sa.sa_handler = onBacktraceSignal;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    ::sigaction(backtraceSignal(), &sa, nullptr);
+  }
+  running_ = true;
+  thread_.start();
+}
+
+void LoopWatchdog::stop()
+{
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    running_ = false;
+  }
+  cond_.notify_one();
+  thread_.join();
+}
+
+void LoopWatchdog::threadFunc()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (running_)
+  {
+    cond_.wait_for(lock, std::chrono::nanoseconds(intervalNs_));
+    if (!running_)
+    {
+      break;
+    }
+    lock.unlock();
+    check();
+    lock.lock();
+  }
+}
+
+void LoopWatchdog::check()
+{
+  std::vector<StallReport> stalls;
+  {
+    // 持锁期间被监视的loop不会被unwatch，读心跳时loop对象一定还在
+    std::unique_lock<std::mutex> lock(mutex_);
+    const int64_t now = Timestamp::monotonicNanos();
+    for (Watched &w : loops_)
+    {
+      const int64_t busySince = w.loop->busySinceNanos();
+      if (w.reportedBusySince != 0 && busySince != w.reportedBusySince)
+      {
+        LOG_ERROR("LoopWatchdog: EventLoop %p recovered after %.3f s\n",
+                  w.loop, (now - w.reportedBusySince) / 1e9);
+        w.reportedBusySince = 0;
+      }
+      if (busySince == 0 || busySince == w.reportedBusySince || now - busySince < stallNs_)
+      {
+        continue;
+      }
+      w.reportedBusySince = busySince;
+
+      StallReport r;
+      r.loop = w.loop;
+      r.tid = w.loop->threadId();
+      r.stalledSeconds = (now - busySince) / 1e9;
+      r.fd = w.loop->currentFd();
+      const std::type_info *functor = w.loop->currentFunctor();
+      if (functor != nullptr)
+      {
+        r.functor = demangle(functor->name());
+      }
+      stalls.push_back(std::move(r));
+    }
+  }
+
+  for (StallReport &r : stalls)
+  {
+    if (captureBacktrace_)
+    {
+      r.backtrace = captureBacktrace(r.tid);
+    }
+    report(r);
+  }
+}
+
+void LoopWatchdog::report(const StallReport &r)
+{
+  if (stallCallback_)
+  {
+    stallCallback_(r);
+    return;
+  }
+  if (r.fd >= 0)
+  {
+    LOG_ERROR("LoopWatchdog: EventLoop %p (tid %d) stalled %.3f s in channel fd %d\n",
+              r.loop, r.tid, r.stalledSeconds, r.fd);
+  }
+  else if (!r.functor.empty())
+  {
+    LOG_ERROR("LoopWatchdog: EventLoop %p (tid %d) stalled %.3f s in functor %s\n",
+              r.loop, r.tid, r.stalledSeconds, r.functor.c_str());
+  }
+  else
+  {
+    LOG_ERROR("LoopWatchdog: EventLoop %p (tid %d) stalled %.3f s\n", r.loop, r.tid, r.stalledSeconds);
+  }
+  for (const std::string &frame : r.backtrace)
+  {
+    LOG_ERROR("    %s\n", frame.c_str());
+  }
+}
+
+std::vector<std::string> LoopWatchdog::captureBacktrace(pid_t tid)
+{
+  std::vector<std::string> frames;
+  std::unique_lock<std::mutex> lock(g_captureMutex);
+  g_depth.store(-1, std::memory_order_relaxed);
+  if (::syscall(SYS_tgkill, ::getpid(), tid, backtraceSignal()) != 0)
+  {
+    return frames;
+  }
+  // 线程可能在不可中断的系统调用里，最多等100ms
+  for (int i = 0; i < 100 && g_depth.load(std::memory_order_acquire) < 0; ++i)
+  {
+    ::usleep(1000);
+  }
+  int depth = g_depth.load(std::memory_order_acquire);
+  if (depth <= 0)
+  {
+    return frames;
+  }
+  char **symbols = ::backtrace_symbols(g_frames, depth);
+  if (symbols == nullptr)
+  {
+    return frames;
+  }
+  // 第0、1帧是信号处理函数和信号跳板
+  for (int i = 2; i < depth; ++i)
+  {
+    frames.push_back(symbols[i]);
+  }
+  ::free(symbols);
+  return frames;
+}
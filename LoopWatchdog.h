@@ -0,0 +1,77 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Thread.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <unistd.h>
+#include <signal.h>
+
+class EventLoop;
+
+/**
+ * loop卡顿看门狗：后台线程定期检查各loop的心跳(EventLoop::busySinceNanos)，
+ * 某个loop离开poll超过stallThreshold秒还没回来时报告一次，说明卡在哪个channel的fd或哪个functor上，
+ * 可选地向该loop线程发信号抓取调用栈。loop恢复后再打印一条恢复日志。
+ */
+class LoopWatchdog : noncopyable
+{
+public:
+  struct StallReport
+  {
+    EventLoop *loop;
+    pid_t tid;                          // loop线程id
+    double stalledSeconds;              // 检测时已经卡住的时长
+    int fd;                             // 正在处理的channel，-1表示不在channel回调里
+    std::string functor;                // 正在执行的pending functor的类型名，可能为空
+    std::vector<std::string> backtrace; // 开启抓栈时loop线程当时的调用栈
+  };
+  using StallCallback = std::function<void(const StallReport &)>;
+
+  // checkInterval<=0时取stallThreshold/4
+  explicit LoopWatchdog(double stallThreshold, double checkInterval = 0);
+  ~LoopWatchdog();
+
+  // 默认用LOG_ERROR打印报告，在看门狗线程中回调
+  void setStallCallback(const StallCallback &cb) { stallCallback_ = cb; }
+  // start之前设置，抓栈通过向loop线程发送backtraceSignal()实现，会为该信号安装处理函数
+  // 卡住的回调如果正在sleep或poll，会因这个信号提前返回EINTR
+  void setCaptureBacktrace(bool on) { captureBacktrace_ = on; }
+  static int backtraceSignal() { return SIGRTMIN + 5; }
+
+  // 可在任意线程调用，loop销毁前必须先unwatch
+  // TcpServer的subloop可能在运行时被removeLoop销毁：在setThreadInitcallback里watch，
+  // 在setThreadExitCallback里unwatch，两者成对设置
+  void watch(EventLoop *loop);
+  void unwatch(EventLoop *loop);
+
+  void start();
+  void stop();
+
+private:
+  struct Watched
+  {
+    EventLoop *loop;
+    int64_t reportedBusySince; // 已经报告过的那一轮，0表示没有
+  };
+
+  void threadFunc();
+  void check();
+  void report(const StallReport &r);
+  static std::vector<std::string> captureBacktrace(pid_t tid);
+
+  const int64_t stallNs_;
+  const int64_t intervalNs_;
+  bool captureBacktrace_;
+  StallCallback stallCallback_;
+
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  bool running_;
+  std::vector<Watched> loops_;
+  Thread thread_;
+};
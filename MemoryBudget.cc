@@ -0,0 +1,52 @@
+#include "MemoryBudget.h"
+
+MemoryBudget::MemoryBudget(MemoryBudget *parent)
+    : parent_(parent),
+      limit_(0),
+      used_(0),
+      peak_(0),
+      pressureEvents_(0)
+{
+}
+
+MemoryBudget *MemoryBudget::process()
+{
+  static MemoryBudget budget;
+  return &budget;
+}
+
+void MemoryBudget::charge(int64_t delta)
+{
+  int64_t used = used_.fetch_add(delta, std::memory_order_relaxed) + delta;
+  if (delta > 0)
+  {
+    int64_t peak = peak_.load(std::memory_order_relaxed);
+    while (used > peak && !peak_.compare_exchange_weak(peak, used, std::memory_order_relaxed))
+    {
+    }
+  }
+  if (parent_ != nullptr)
+  {
+    parent_->charge(delta);
+  }
+}
+
+bool MemoryBudget::exhausted() const
+{
+  int64_t limit = this->limit();
+  if (limit > 0 && used() >= limit)
+  {
+    return true;
+  }
+  return parent_ != nullptr && parent_->exhausted();
+}
+
+bool MemoryBudget::relieved() const
+{
+  int64_t limit = this->limit();
+  if (limit > 0 && used() >= limit - limit / 8)
+  {
+    return false;
+  }
+  return parent_ == nullptr || parent_->relieved();
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <atomic>
+#include <stdint.h>
+
+/**
+ * 连接缓冲区的内存预算，按Buffer的容量记账，单位字节，可在任意线程记账和查询。
+ * 每个EventLoop一个(EventLoop::memoryBudget())，父预算是进程级的MemoryBudget::process()，记账时一并计入父预算。
+ * 预算只记账不拦截扩容，超出时由TcpConnection暂停占用最多的连接的读，见TcpServer::setMemoryBudget。
+ */
+class MemoryBudget : noncopyable
+{
+public:
+  explicit MemoryBudget(MemoryBudget *parent = nullptr);
+
+  // 进程级预算，所有loop预算的父预算
+  static MemoryBudget *process();
+
+  // 上限，0表示不限(默认)
+  void setLimit(int64_t bytes) { limit_.store(bytes, std::memory_order_relaxed); }
+  int64_t limit() const { return limit_.load(std::memory_order_relaxed); }
+  int64_t used() const { return used_.load(std::memory_order_relaxed); }
+  int64_t peak() const { return peak_.load(std::memory_order_relaxed); }
+
+  // 因超出预算被暂停读或关闭的次数
+  uint64_t pressureEvents() const { return pressureEvents_.load(std::memory_order_relaxed); }
+  void countPressureEvent() { pressureEvents_.fetch_add(1, std::memory_order_relaxed); }
+
+  // Buffer容量变化时调用，delta可以为负
+  void charge(int64_t delta);
+
+  // 本预算或父预算用到了上限
+  bool exhausted() const;
+  // 本预算和父预算都回落到上限的7/8以下，暂停的连接可以恢复
+  bool relieved() const;
+
+private:
+  MemoryBudget *parent_;
+  std::atomic<int64_t> limit_;
+  std::atomic<int64_t> used_;
+  std::atomic<int64_t> peak_;
+  std::atomic<uint64_t> pressureEvents_;
+};
@@ -0,0 +1,43 @@
+#include "MemoryGovernor.h"
+#include "EventLoop.h"
+#include "TcpConnection.h"
+
+MemoryGovernor::MemoryGovernor(EventLoop *loop, double checkSeconds)
+    : loop_(loop),
+      checkSeconds_(checkSeconds),
+      timerId_(-1)
+{
+}
+
+void MemoryGovernor::add(const TcpConnectionPtr &conn)
+{
+  paused_.push_back(conn);
+  if (timerId_ < 0)
+  {
+    timerId_ = loop_->runEvery(checkSeconds_, std::bind(&MemoryGovernor::check, this));
+  }
+}
+
+void MemoryGovernor::check()
+{
+  if (!loop_->memoryBudget()->relieved())
+  {
+    return;
+  }
+  std::vector<std::weak_ptr<TcpConnection>> paused;
+  paused.swap(paused_);
+  for (const auto &item : paused)
+  {
+    // 已经迁走的连接由新loop的MemoryGovernor负责
+    TcpConnectionPtr conn = item.lock();
+    if (conn && conn->getLoop() == loop_)
+    {
+      conn->resumeFromMemoryPressure();
+    }
+  }
+  if (paused_.empty())
+  {
+    loop_->cancel(timerId_);
+    timerId_ = -1;
+  }
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+
+#include <memory>
+#include <vector>
+
+class EventLoop;
+
+/**
+ * 每个loop一个(EventLoop::memoryGovernor())，只在loop线程中使用。
+ * 记录因内存预算用尽而暂停读的连接，定时检查预算，回落之后统一恢复它们；没有暂停的连接时定时器停掉。
+ */
+class MemoryGovernor : noncopyable
+{
+public:
+  explicit MemoryGovernor(EventLoop *loop, double checkSeconds = 0.01);
+
+  // 由TcpConnection在暂停读之后登记
+  void add(const TcpConnectionPtr &conn);
+  size_t numPaused() const { return paused_.size(); }
+
+private:
+  void check();
+
+  EventLoop *loop_;
+  const double checkSeconds_;
+  int64_t timerId_; // 定时器停掉时为-1
+  std::vector<std::weak_ptr<TcpConnection>> paused_;
+};
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+/**
+ * 不可变共享数据块中的一段，拷贝只增加引用计数，不拷贝数据。
+ * 广播时同一条消息交给成千上万个连接发送(TcpConnection::send(const Payload &))，
+ * 各连接的发送队列里只放引用，handleWrite直接从共享块writev，最后一个连接发完后数据块释放。
+ */
+class Payload
+{
+public:
+  Payload() : data_(nullptr), size_(0) {}
+
+  // 共享block，之后不能再修改它
+  explicit Payload(std::shared_ptr<const std::string> block)
+      : block_(std::move(block)),
+        data_(block_ ? block_->data() : nullptr),
+        size_(block_ ? block_->size() : 0)
+  {
+  }
+
+  // 拷贝一份数据生成新的数据块
+  static Payload copyOf(const void *data, size_t len)
+  {
+    return Payload(std::make_shared<std::string>(static_cast<const char *>(data), len));
+  }
+
+  const char *data() const { return data_; }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  // 共享同一数据块的Payload个数
+  long useCount() const { return block_.use_count(); }
+
+  // 从offset开始的len字节，和本Payload共享数据块
+  Payload slice(size_t offset, size_t len) const
+  {
+    Payload p(*this);
+    p.data_ += offset;
+    p.size_ = len;
+    return p;
+  }
+
+  // 丢掉开头len字节，len等于size()时释放对数据块的引用
+  void retrieve(size_t len)
+  {
+    if (len < size_)
+    {
+      data_ += len;
+      size_ -= len;
+    }
+    else
+    {
+      *this = Payload();
+    }
+  }
+
+private:
+  std::shared_ptr<const std::string> block_;
+  const char *data_;
+  size_t size_;
+};
@@ -33,6 +33,8 @@ protected:
   using ChannelMap = std::unordered_map<int, Channel *>;
   ChannelMap channels_;
 
+  EventLoop *ownerLoop() const { return owenrLoop_; }
+
 private:
   EventLoop *owenrLoop_; // 自身所属事件循环
 };
\ No newline at end of file
@@ -0,0 +1,264 @@
+#include "PreforkServer.h"
+#include "TcpServer.h"
+#include "EventLoop.h"
+#include "Channel.h"
+#include "Logger.h"
+
+#include <new>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+PreforkServer::PreforkServer(const InetAddress &listenAddr, const std::string &nameArg, int numWorkers)
+    : listenAddr_(listenAddr),
+      name_(nameArg),
+      numWorkers_(numWorkers),
+      placeholderFd_(-1),
+      slots_(nullptr),
+      pids_(numWorkers, -1),
+      startTime_(numWorkers, 0)
+{
+}
+
+PreforkServer::~PreforkServer()
+{
+  if (slots_ != nullptr)
+  {
+    ::munmap(slots_, sizeof(WorkerStats) * numWorkers_);
+    if (!shmName_.empty())
+    {
+      ::shm_unlink(shmName_.c_str());
+    }
+  }
+  if (placeholderFd_ >= 0)
+  {
+    ::close(placeholderFd_);
+  }
+}
+
+void PreforkServer::mapStats()
+{
+  size_t len = sizeof(WorkerStats) * numWorkers_;
+  void *addr = MAP_FAILED;
+  if (shmName_.empty())
+  {
+    addr = ::mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  }
+  else
+  {
+    int fd = ::shm_open(shmName_.c_str(), O_CREAT | O_RDWR, 0644);
+    if (fd >= 0 && ::ftruncate(fd, len) == 0)
+    {
+      addr = ::mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (fd >= 0)
+    {
+      ::close(fd);
+    }
+  }
+  if (addr == MAP_FAILED)
+  {
+    LOG_FATAL("%s:%s:%d stats shm map err:%d \n", __FILE__, __FUNCTION__, __LINE__, errno);
+  }
+
+  slots_ = static_cast<WorkerStats *>(addr);
+  for (int i = 0; i < numWorkers_; ++i)
+  {
+    WorkerStats *slot = new (&slots_[i]) WorkerStats;
+    slot->pid = 0;
+    slot->restarts = 0;
+    slot->connections = 0;
+    slot->accepted = 0;
+    slot->heartbeat = 0;
+  }
+}
+
+void PreforkServer::run()
+{
+  // 先占住端口，端口被别人占用时在fork之前就失败
+  placeholderFd_ = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  int on = 1;
+  ::setsockopt(placeholderFd_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof on);
+  ::setsockopt(placeholderFd_, SOL_SOCKET, SO_REUSEPORT, &on, sizeof on);
+  if (::bind(placeholderFd_, (const sockaddr *)listenAddr_.getSockAddr(), sizeof(sockaddr_in)) < 0)
+  {
+    LOG_FATAL("%s:%s:%d bind %s err:%d \n", __FILE__, __FUNCTION__, __LINE__, listenAddr_.toIpPort().c_str(), errno);
+  }
+  mapStats();
+
+  // supervisor同步等待信号，不装信号处理函数
+  sigset_t mask;
+  sigset_t oldMask;
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGCHLD);
+  sigaddset(&mask, SIGTERM);
+  sigaddset(&mask, SIGINT);
+  ::sigprocmask(SIG_BLOCK, &mask, &oldMask);
+
+  // 只统计fork成功的worker，失败的槽位pids_为-1，之后每轮重试
+  int alive = 0;
+  for (int i = 0; i < numWorkers_; ++i)
+  {
+    if (spawn(i))
+    {
+      ++alive;
+    }
+  }
+
+  bool stopping = false;
+  while (alive > 0)
+  {
+    timespec timeout = {1, 0};
+    int sig = ::sigtimedwait(&mask, nullptr, &timeout);
+    if ((sig == SIGTERM || sig == SIGINT) && !stopping)
+    {
+      stopping = true;
+      LOG_INFO("PreforkServer [%s] stopping %d workers \n", name_.c_str(), alive);
+      for (pid_t pid : pids_)
+      {
+        if (pid > 0)
+        {
+          ::kill(pid, SIGTERM);
+        }
+      }
+    }
+
+    int status = 0;
+    pid_t pid;
+    while ((pid = ::waitpid(-1, &status, WNOHANG)) > 0)
+    {
+      for (int i = 0; i < numWorkers_; ++i)
+      {
+        if (pids_[i] != pid)
+        {
+          continue;
+        }
+        pids_[i] = -1;
+        slots_[i].pid = 0;
+        slots_[i].connections = 0;
+        --alive;
+        if (!stopping)
+        {
+          LOG_ERROR("PreforkServer [%s] worker %d pid %d exited status:%d, restarting \n", name_.c_str(), i, pid, status);
+          slots_[i].restarts.fetch_add(1);
+          if (spawn(i))
+          {
+            ++alive;
+          }
+        }
+        break;
+      }
+    }
+
+    // 之前fork失败的worker重新拉起
+    for (int i = 0; i < numWorkers_ && !stopping; ++i)
+    {
+      if (pids_[i] < 0 && spawn(i))
+      {
+        ++alive;
+      }
+    }
+
+    if (statsCallback_)
+    {
+      statsCallback_(stats());
+    }
+  }
+
+  if (!stopping)
+  {
+    LOG_ERROR("PreforkServer [%s] no worker could be started \n", name_.c_str());
+  }
+  ::sigprocmask(SIG_SETMASK, &oldMask, nullptr);
+}
+
+bool PreforkServer::spawn(int index)
+{
+  // 同一个worker一秒内最多拉起一次，避免启动即崩溃时疯狂fork
+  int64_t now = ::time(nullptr);
+  if (now - startTime_[index] < 1)
+  {
+    ::sleep(1);
+  }
+  startTime_[index] = ::time(nullptr);
+
+  pid_t pid = ::fork();
+  if (pid < 0)
+  {
+    LOG_ERROR("PreforkServer [%s] fork err:%d \n", name_.c_str(), errno);
+    return false;
+  }
+  if (pid == 0)
+  {
+    ::close(placeholderFd_);
+    runWorker(index);
+    ::_exit(0); // 不执行父进程的析构和atexit
+  }
+  pids_[index] = pid;
+  slots_[index].pid = pid;
+  return true;
+}
+
+// 在worker进程里运行
+void PreforkServer::runWorker(int index)
+{
+  // 用signalfd把SIGTERM/SIGINT变成loop里的读事件，正常退出loop
+  sigset_t mask;
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGTERM);
+  sigaddset(&mask, SIGINT);
+  ::sigprocmask(SIG_SETMASK, &mask, nullptr);
+  int sigfd = ::signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+
+  EventLoop loop;
+  TcpServer server(&loop, listenAddr_, name_ + "-w" + std::to_string(index), TcpServer::kReusePort);
+  if (serverInitCallback_)
+  {
+    serverInitCallback_(&server);
+  }
+
+  Channel sigChannel(&loop, sigfd);
+  sigChannel.setReadCallback([&loop, sigfd](Timestamp)
+                             {
+    signalfd_siginfo info;
+    ::read(sigfd, &info, sizeof info);
+    loop.quit(); });
+  sigChannel.enableReading();
+
+  WorkerStats &slot = slots_[index];
+  loop.runEvery(0.5, [&slot, &server]()
+                {
+    slot.connections.store(server.numConnections(), std::memory_order_relaxed);
+    slot.accepted.store(server.numAccepted(), std::memory_order_relaxed);
+    slot.heartbeat.store(::time(nullptr), std::memory_order_relaxed); });
+
+  server.start();
+  loop.loop();
+
+  sigChannel.disableAll();
+  sigChannel.remove();
+  ::close(sigfd);
+}
+
+PreforkServer::Stats PreforkServer::stats() const
+{
+  Stats stats = {0, 0, 0, 0};
+  for (int i = 0; slots_ != nullptr && i < numWorkers_; ++i)
+  {
+    if (slots_[i].pid.load(std::memory_order_relaxed) > 0)
+    {
+      ++stats.workers;
+    }
+    stats.restarts += slots_[i].restarts.load(std::memory_order_relaxed);
+    stats.connections += slots_[i].connections.load(std::memory_order_relaxed);
+    stats.accepted += slots_[i].accepted.load(std::memory_order_relaxed);
+  }
+  return stats;
+}
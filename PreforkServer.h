@@ -0,0 +1,77 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "InetAddress.h"
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <sys/types.h>
+
+class TcpServer;
+
+/**
+ * 多进程模式：supervisor进程先bind占住端口，再fork出numWorkers个worker进程，
+ * 每个worker有自己的EventLoop和SO_REUSEPORT监听socket，进程之间不共享堆和锁。
+ * worker崩溃后supervisor自动拉起，各worker的统计数据写在共享内存里。
+ * EventLoop不能跨fork使用，所以TcpServer在worker进程里创建，通过ServerInitCallback配置。
+ */
+class PreforkServer : noncopyable
+{
+public:
+  using ServerInitCallback = std::function<void(TcpServer *)>;
+
+  // 共享内存里每个worker一个槽位，所有字段都是进程间无锁原子量
+  struct WorkerStats
+  {
+    std::atomic<int64_t> pid;
+    std::atomic<uint64_t> restarts;    // 被supervisor重新拉起的次数
+    std::atomic<uint64_t> connections; // 当前连接数
+    std::atomic<uint64_t> accepted;    // 累计接受的连接数
+    std::atomic<int64_t> heartbeat;    // 最近一次上报的时间(秒)
+  };
+
+  struct Stats
+  {
+    int workers;
+    uint64_t restarts;
+    uint64_t connections;
+    uint64_t accepted;
+  };
+  using StatsCallback = std::function<void(const Stats &)>;
+
+  PreforkServer(const InetAddress &listenAddr, const std::string &nameArg, int numWorkers);
+  ~PreforkServer();
+
+  // 在worker进程里、TcpServer::start之前调用，用于设置回调和线程数
+  void setServerInitCallback(const ServerInitCallback &cb) { serverInitCallback_ = cb; }
+  // supervisor每隔1秒回调一次汇总的统计
+  void setStatsCallback(const StatsCallback &cb) { statsCallback_ = cb; }
+  // run之前设置，统计放到POSIX共享内存/dev/shm/<name>里，外部进程可以直接mmap读取
+  void setStatsShmName(const std::string &shmName) { shmName_ = shmName; }
+
+  // 阻塞运行supervisor，收到SIGTERM/SIGINT后通知所有worker退出，全部回收后返回
+  void run();
+
+  Stats stats() const;
+  const WorkerStats &workerStats(int index) const { return slots_[index]; }
+
+private:
+  bool spawn(int index); // fork失败时返回false
+  void runWorker(int index);
+  void mapStats();
+
+  const InetAddress listenAddr_;
+  const std::string name_;
+  const int numWorkers_;
+  ServerInitCallback serverInitCallback_;
+  StatsCallback statsCallback_;
+  std::string shmName_;
+
+  int placeholderFd_;              // supervisor持有的bind但不listen的socket
+  WorkerStats *slots_;             // 共享内存，fork之前映射
+  std::vector<pid_t> pids_;        // 下标为worker编号
+  std::vector<int64_t> startTime_; // 各worker最近一次启动的时间(秒)
+};
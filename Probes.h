@@ -0,0 +1,43 @@
+#pragma once
+
+/**
+ * USDT静态探针，供perf/bpftrace挂载，provider名为mymuduo。
+ * 编译时定义MYMUDUO_USDT(cmake -DMYMUDUO_USDT=ON，需要systemtap的sys/sdt.h)才会生成探针，
+ * 生成的探针在没人挂载时只是一条nop；不定义时整个宏展开为空。
+ * 参数只放整数和指针，字符串参数传const char*，bpftrace里用str()读取。
+ *
+ *   accept             (connfd, listenfd)
+ *   conn_established   (fd, TcpConnection*, const char *name)
+ *   conn_destroyed     (fd, bytesRead, bytesWritten)
+ *   buffer_read        (fd, n)          readv的返回值，出错时为-1
+ *   buffer_write       (fd, n)
+ *   poll_enter         (EventLoop*, epollfd, numChannels)
+ *   poll_exit          (EventLoop*, epollfd, numEvents)
+ *   queue_in_loop      (EventLoop*, inLoopThread)
+ *   wakeup             (EventLoop*)
+ *   high_water         (fd, bufferedBytes)
+ */
+#ifdef MYMUDUO_USDT
+
+#include <sys/sdt.h>
+
+#define MYMUDUO_PROBE1(name, a1) DTRACE_PROBE1(mymuduo, name, a1)
+#define MYMUDUO_PROBE2(name, a1, a2) DTRACE_PROBE2(mymuduo, name, a1, a2)
+#define MYMUDUO_PROBE3(name, a1, a2, a3) DTRACE_PROBE3(mymuduo, name, a1, a2, a3)
+
+#else
+
+#define MYMUDUO_PROBE1(name, a1) \
+  do                             \
+  {                              \
+  } while (0)
+#define MYMUDUO_PROBE2(name, a1, a2) \
+  do                                 \
+  {                                  \
+  } while (0)
+#define MYMUDUO_PROBE3(name, a1, a2, a3) \
+  do                                     \
+  {                                      \
+  } while (0)
+
+#endif
@@ -0,0 +1,59 @@
+#include "SendRing.h"
+
+#include <algorithm>
+#include <thread>
+#include <string.h>
+
+static size_t roundUpPowerOfTwo(size_t n)
+{
+  size_t size = 1;
+  while (size < n)
+  {
+    size <<= 1;
+  }
+  return size;
+}
+
+SendRing::SendRing(size_t capacity)
+    : buffer_(new char[roundUpPowerOfTwo(capacity)]),
+      mask_(roundUpPowerOfTwo(capacity) - 1),
+      reserved_(0),
+      committed_(0),
+      consumed_(0)
+{
+}
+
+bool SendRing::tryWrite(const void *data, size_t len)
+{
+  uint64_t pos = reserved_.load(std::memory_order_relaxed);
+  do
+  {
+    if (pos + len - consumed_.load(std::memory_order_acquire) > capacity())
+    {
+      return false;
+    }
+  } while (!reserved_.compare_exchange_weak(pos, pos + len, std::memory_order_relaxed));
+
+  // 可能绕回到开头，分两段拷贝
+  const size_t offset = static_cast<size_t>(pos) & mask_;
+  const size_t first = std::min(len, capacity() - offset);
+  memcpy(buffer_.get() + offset, data, first);
+  memcpy(buffer_.get(), static_cast<const char *>(data) + first, len - first);
+
+  // 按预留顺序提交，前面的生产者还在拷贝时让出cpu等它
+  while (committed_.load(std::memory_order_acquire) != pos)
+  {
+    std::this_thread::yield();
+  }
+  // 和TcpConnection里的dirty标志配对，需要seq_cst，见TcpConnection::handleSendRing
+  committed_.store(pos + len, std::memory_order_seq_cst);
+  return true;
+}
+
+const char *SendRing::peek(size_t *len) const
+{
+  const uint64_t pos = consumed_.load(std::memory_order_relaxed);
+  const size_t offset = static_cast<size_t>(pos) & mask_;
+  *len = std::min(readableBytes(), capacity() - offset);
+  return buffer_.get() + offset;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <atomic>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * 连接的发送环，多个生产者线程、一个消费者(连接所属的loop线程)的字节环形缓冲区。
+ * 生产者用CAS预留一段空间，拷贝后按预留顺序提交，每次写入的字节连续，不会和其他生产者交错；
+ * 只有一个生产者时不会等待。消费者只读已提交的部分，读完后释放空间。
+ * 由TcpConnection::enableSendRing创建，见TcpConnection::send。
+ */
+class SendRing : noncopyable
+{
+public:
+  // 容量向上取整到2的幂
+  explicit SendRing(size_t capacity);
+
+  size_t capacity() const { return mask_ + 1; }
+
+  // 任意线程：写入len字节，空间不够时什么也不写，返回false
+  bool tryWrite(const void *data, size_t len);
+
+  // 以下只能在消费者线程中调用
+  // 已提交还没读的字节数
+  size_t readableBytes() const
+  {
+    return static_cast<size_t>(committed_.load(std::memory_order_seq_cst) - consumed_.load(std::memory_order_relaxed));
+  }
+  // 从读位置开始不绕回的一段，*len最多为readableBytes()
+  const char *peek(size_t *len) const;
+  void retrieve(size_t len) { consumed_.store(consumed_.load(std::memory_order_relaxed) + len, std::memory_order_release); }
+
+private:
+  std::unique_ptr<char[]> buffer_;
+  const size_t mask_;
+  std::atomic<uint64_t> reserved_;  // 生产者预留到的位置
+  std::atomic<uint64_t> committed_; // 已提交(可读)到的位置
+  std::atomic<uint64_t> consumed_;  // 消费者读到的位置
+};
@@ -6,7 +6,9 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/tcp.h>
+#include <linux/net_tstamp.h>
 #include <string.h>
+#include <errno.h>
 
 Socket ::~Socket()
 {
@@ -69,4 +71,14 @@ void Socket ::setKeepAlive(bool on)
 {
   int optval = on ? 1 : 0;
   ::setsockopt(sockfd_, SOL_SOCKET, SO_KEEPALIVE, &optval, sizeof optval);
-}
\ No newline at end of file
+}
+bool Socket ::setReceiveTimestamps(bool on)
+{
+  int optval = on ? (SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE) : 0;
+  if (::setsockopt(sockfd_, SOL_SOCKET, SO_TIMESTAMPING, &optval, sizeof optval) < 0)
+  {
+    LOG_ERROR("setsockopt SO_TIMESTAMPING on fd %d failed: %d\n", sockfd_, errno);
+    return false;
+  }
+  return true;
+}
@@ -21,6 +21,8 @@ public:
   void setReuseAddr(bool on);
   void setReusePort(bool on);
   void setKeepAlive(bool on);
+  // 开启SO_TIMESTAMPING软件接收时间戳，recvmsg时随数据带回内核收到数据的时间
+  bool setReceiveTimestamps(bool on);
 
 private:
   const int sockfd_;
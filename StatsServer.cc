@@ -0,0 +1,451 @@
+#include "StatsServer.h"
+#include "Logger.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+namespace
+{
+  const double kQuantiles[] = {0.5, 0.9, 0.99, 0.999};
+  const double kCollectTimeout = 2.0; // 秒
+
+  void appendf(std::string *out, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+  void appendf(std::string *out, const char *fmt, ...)
+  {
+    char buf[512];
+    va_list args;
+    va_start(args, fmt);
+    va_list retry;
+    va_copy(retry, args);
+    int n = vsnprintf(buf, sizeof buf, fmt, args);
+    va_end(args);
+    if (n > 0 && static_cast<size_t>(n) < sizeof buf)
+    {
+      out->append(buf, n);
+    }
+    else if (n > 0)
+    {
+      // 放不下时按需要的长度再格式化一次，不截断
+      std::string big(n + 1, '\0');
+      vsnprintf(&big[0], big.size(), fmt, retry);
+      out->append(big.data(), n);
+    }
+    va_end(retry);
+  }
+
+  // Prometheus标签值里的反斜杠、双引号和换行要转义
+  std::string escapeLabel(const std::string &value)
+  {
+    std::string out;
+    for (char c : value)
+    {
+      if (c == '\\' || c == '"')
+      {
+        out.push_back('\\');
+        out.push_back(c);
+      }
+      else if (c == '\n')
+      {
+        out.append("\\n");
+      }
+      else
+      {
+        out.push_back(c);
+      }
+    }
+    return out;
+  }
+
+  // JSON字符串里的反斜杠、双引号和控制字符要转义
+  std::string escapeJson(const std::string &value)
+  {
+    std::string out;
+    for (char c : value)
+    {
+      if (c == '\\' || c == '"')
+      {
+        out.push_back('\\');
+        out.push_back(c);
+      }
+      else if (c == '\n')
+      {
+        out.append("\\n");
+      }
+      else if (static_cast<unsigned char>(c) < 0x20)
+      {
+        char hex[8];
+        snprintf(hex, sizeof hex, "\\u%04x", static_cast<unsigned char>(c));
+        out.append(hex);
+      }
+      else
+      {
+        out.push_back(c);
+      }
+    }
+    return out;
+  }
+
+  void typeLine(std::string *out, const char *name, const char *type)
+  {
+    appendf(out, "# TYPE mymuduo_%s %s\n", name, type);
+  }
+
+  // 直方图输出成Prometheus的summary，scale把记录值换算成输出单位(纳秒=>秒时为1e-9)
+  void summary(std::string *out, const char *name, const std::string &labels,
+               const Histogram::Snapshot &h, double scale)
+  {
+    for (double q : kQuantiles)
+    {
+      appendf(out, "mymuduo_%s{%s,quantile=\"%g\"} %g\n", name, labels.c_str(), q, h.percentile(q * 100) * scale);
+    }
+    appendf(out, "mymuduo_%s_sum{%s} %g\n", name, labels.c_str(), h.sum * scale);
+    appendf(out, "mymuduo_%s_count{%s} %llu\n", name, labels.c_str(), static_cast<unsigned long long>(h.count));
+  }
+
+  void jsonHistogram(std::string *out, const char *name, const Histogram::Snapshot &h, double scale)
+  {
+    appendf(out, "\"%s\":{\"count\":%llu,\"mean\":%g,\"max\":%g", name,
+            static_cast<unsigned long long>(h.count), h.mean() * scale, h.max * scale);
+    for (double q : kQuantiles)
+    {
+      appendf(out, ",\"p%g\":%g", q * 100, h.percentile(q * 100) * scale);
+    }
+    out->append("}");
+  }
+}
+
+StatsServer::StatsServer(EventLoop *loop, const InetAddress &listenAddr, TcpServer *target)
+    : loop_(loop),
+      server_(loop, listenAddr, target->name() + "-stats"),
+      target_(target)
+{
+  server_.setMessageCallback(std::bind(&StatsServer::onMessage, this,
+                                       std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+}
+
+void StatsServer::onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+{
+  std::string request(buf->peek(), buf->readableBytes());
+  if (request.find("\r\n\r\n") == std::string::npos)
+  {
+    if (request.size() > 8192)
+    {
+      conn->shutdown();
+    }
+    return; // 请求头还没收全
+  }
+  buf->retrieveAll();
+
+  // 只看请求行: GET /path HTTP/1.1
+  char method[16] = {0};
+  char path[256] = {0};
+  if (sscanf(request.c_str(), "%15s %255s", method, path) != 2 || strcmp(method, "GET") != 0)
+  {
+    respond(conn, 405, "text/plain", "method not allowed\n");
+    return;
+  }
+  std::string target(path);
+  target = target.substr(0, target.find('?'));
+  if (target == "/metrics")
+  {
+    collect(conn, false);
+  }
+  else if (target == "/stats")
+  {
+    collect(conn, true);
+  }
+  else
+  {
+    respond(conn, 404, "text/plain", "try /metrics or /stats\n");
+  }
+}
+
+void StatsServer::collect(const TcpConnectionPtr &conn, bool json)
+{
+  CollectionPtr c(new Collection);
+  c->conn = conn;
+  c->json = json;
+  c->pending = 1; // 被监控server的baseloop
+  c->done = false;
+  c->accepted = 0;
+  c->rejected = 0;
+  c->connections = 0;
+  c->timerId = loop_->runAfter(kCollectTimeout, std::bind(&StatsServer::timeout, this, c));
+
+  // 持着线程池的锁投递，投递时loop一定还在，之后即使被retire也会先执行完这个任务
+  target_->threadPool()->forEachLoop([this, c](EventLoop *ioLoop, size_t i)
+                                     {
+    c->loops.resize(i + 1);
+    ++c->pending;
+    ioLoop->queueInLoop([this, c, i, ioLoop]()
+                        {
+      LoopSnapshot snap;
+      snap.metrics = ioLoop->metrics();
+      snap.connections = ioLoop->connectionCount();
+      snap.pendingBytes = ioLoop->pendingBytes();
+      snap.overloaded = ioLoop->overloaded();
+      snap.bufferBytes = ioLoop->memoryBudget()->used();
+      snap.bufferLimit = ioLoop->memoryBudget()->limit();
+      snap.pressureEvents = ioLoop->memoryBudget()->pressureEvents();
+      snap.memoryPaused = ioLoop->numMemoryPaused();
+      loop_->runInLoop([this, c, i, snap]()
+                       {
+        c->loops[i] = snap;
+        finishOne(c); }); }); });
+
+  // 连接表只能在被监控server的baseloop里读
+  EventLoop *baseLoop = target_->getLoop();
+  baseLoop->runInLoop([this, c]()
+                      {
+    uint64_t accepted = target_->numAccepted();
+    uint64_t rejected = target_->numRejected();
+    size_t connections = target_->numConnections();
+    ConnectionStats traffic = target_->connectionStats();
+    Histogram::Snapshot latency = target_->latencySnapshot();
+    loop_->runInLoop([this, c, accepted, rejected, connections, traffic, latency]()
+                     {
+      c->accepted = accepted;
+      c->rejected = rejected;
+      c->connections = connections;
+      c->traffic = traffic;
+      c->latency = latency;
+      finishOne(c); }); });
+}
+
+void StatsServer::finishOne(const CollectionPtr &c)
+{
+  if (c->done || --c->pending > 0)
+  {
+    return;
+  }
+  c->done = true;
+  loop_->cancel(c->timerId);
+  if (c->json)
+  {
+    respond(c->conn, 200, "application/json", renderJson(*c));
+  }
+  else
+  {
+    respond(c->conn, 200, "text/plain; version=0.0.4", renderPrometheus(*c));
+  }
+}
+
+void StatsServer::timeout(const CollectionPtr &c)
+{
+  if (c->done)
+  {
+    return;
+  }
+  c->done = true;
+  LOG_ERROR("StatsServer [%s] - %d snapshots not back after %g s\n", target_->name().c_str(), c->pending, kCollectTimeout);
+  respond(c->conn, 503, "text/plain", "stats collection timed out\n");
+}
+
+void StatsServer::respond(const TcpConnectionPtr &conn, int status, const char *contentType, const std::string &body)
+{
+  const char *reason = status == 200   ? "OK"
+                       : status == 404 ? "Not Found"
+                       : status == 503 ? "Service Unavailable"
+                                       : "Method Not Allowed";
+  std::string response;
+  appendf(&response, "HTTP/1.1 %d %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n",
+          status, reason, contentType, body.size());
+  response += body;
+  conn->send(response);
+  conn->shutdown();
+}
+
+std::string StatsServer::renderPrometheus(const Collection &c) const
+{
+  std::string out;
+  std::string server = "server=\"" + escapeLabel(target_->name()) + "\"";
+  const double ns = 1e-9;
+
+  typeLine(&out, "accepted_total", "counter");
+  appendf(&out, "mymuduo_accepted_total{%s} %llu\n", server.c_str(), static_cast<unsigned long long>(c.accepted));
+  typeLine(&out, "rejected_total", "counter");
+  appendf(&out, "mymuduo_rejected_total{%s} %llu\n", server.c_str(), static_cast<unsigned long long>(c.rejected));
+  const MemoryBudget *process = MemoryBudget::process();
+  typeLine(&out, "process_buffer_bytes", "gauge");
+  appendf(&out, "mymuduo_process_buffer_bytes %lld\n", static_cast<long long>(process->used()));
+  typeLine(&out, "process_buffer_peak_bytes", "gauge");
+  appendf(&out, "mymuduo_process_buffer_peak_bytes %lld\n", static_cast<long long>(process->peak()));
+  typeLine(&out, "process_buffer_limit_bytes", "gauge");
+  appendf(&out, "mymuduo_process_buffer_limit_bytes %lld\n", static_cast<long long>(process->limit()));
+  typeLine(&out, "connections", "gauge");
+  appendf(&out, "mymuduo_connections{%s} %zu\n", server.c_str(), c.connections);
+
+  const ConnectionStats &t = c.traffic;
+  struct
+  {
+    const char *name;
+    uint64_t value;
+  } counters[] = {
+      {"bytes_read_total", t.bytesRead},
+      {"bytes_written_total", t.bytesWritten},
+      {"read_calls_total", t.readCalls},
+      {"write_calls_total", t.writeCalls},
+      {"high_water_total", t.highWaterEvents},
+      {"zerocopy_sends_total", t.zeroCopySends},
+      {"zerocopy_bytes_total", t.zeroCopyBytes},
+      {"zerocopy_copied_total", t.zeroCopyCopied},
+  };
+  for (const auto &counter : counters)
+  {
+    typeLine(&out, counter.name, "counter");
+    appendf(&out, "mymuduo_%s{%s} %llu\n", counter.name, server.c_str(), static_cast<unsigned long long>(counter.value));
+  }
+  typeLine(&out, "output_buffered_seconds_total", "counter");
+  appendf(&out, "mymuduo_output_buffered_seconds_total{%s} %g\n", server.c_str(), t.outputBufferedNs * ns);
+  if (c.latency.count > 0)
+  {
+    typeLine(&out, "request_latency_seconds", "summary");
+    summary(&out, "request_latency_seconds", server, c.latency, ns);
+  }
+
+  // 各loop的指标，同一个指标的各loop放在一起
+  std::vector<std::string> labels;
+  for (size_t i = 0; i < c.loops.size(); ++i)
+  {
+    char label[32];
+    snprintf(label, sizeof label, ",loop=\"%zu\"", i);
+    labels.push_back(server + label);
+  }
+  typeLine(&out, "loop_connections", "gauge");
+  for (size_t i = 0; i < c.loops.size(); ++i)
+  {
+    appendf(&out, "mymuduo_loop_connections{%s} %d\n", labels[i].c_str(), c.loops[i].connections);
+  }
+  typeLine(&out, "loop_pending_output_bytes", "gauge");
+  for (size_t i = 0; i < c.loops.size(); ++i)
+  {
+    appendf(&out, "mymuduo_loop_pending_output_bytes{%s} %lld\n", labels[i].c_str(),
+            static_cast<long long>(c.loops[i].pendingBytes));
+  }
+  typeLine(&out, "loop_overloaded", "gauge");
+  for (size_t i = 0; i < c.loops.size(); ++i)
+  {
+    appendf(&out, "mymuduo_loop_overloaded{%s} %d\n", labels[i].c_str(), c.loops[i].overloaded ? 1 : 0);
+  }
+  typeLine(&out, "loop_buffer_bytes", "gauge");
+  for (size_t i = 0; i < c.loops.size(); ++i)
+  {
+    appendf(&out, "mymuduo_loop_buffer_bytes{%s} %lld\n", labels[i].c_str(), static_cast<long long>(c.loops[i].bufferBytes));
+  }
+  typeLine(&out, "loop_buffer_limit_bytes", "gauge");
+  for (size_t i = 0; i < c.loops.size(); ++i)
+  {
+    appendf(&out, "mymuduo_loop_buffer_limit_bytes{%s} %lld\n", labels[i].c_str(), static_cast<long long>(c.loops[i].bufferLimit));
+  }
+  typeLine(&out, "loop_memory_paused", "gauge");
+  for (size_t i = 0; i < c.loops.size(); ++i)
+  {
+    appendf(&out, "mymuduo_loop_memory_paused{%s} %zu\n", labels[i].c_str(), c.loops[i].memoryPaused);
+  }
+  typeLine(&out, "loop_memory_pressure_total", "counter");
+  for (size_t i = 0; i < c.loops.size(); ++i)
+  {
+    appendf(&out, "mymuduo_loop_memory_pressure_total{%s} %llu\n", labels[i].c_str(),
+            static_cast<unsigned long long>(c.loops[i].pressureEvents));
+  }
+  typeLine(&out, "loop_iterations_total", "counter");
+  for (size_t i = 0; i < c.loops.size(); ++i)
+  {
+    appendf(&out, "mymuduo_loop_iterations_total{%s} %llu\n", labels[i].c_str(),
+            static_cast<unsigned long long>(c.loops[i].metrics.iterations));
+  }
+  typeLine(&out, "loop_wakeups_total", "counter");
+  for (size_t i = 0; i < c.loops.size(); ++i)
+  {
+    appendf(&out, "mymuduo_loop_wakeups_total{%s} %llu\n", labels[i].c_str(),
+            static_cast<unsigned long long>(c.loops[i].metrics.wakeups));
+  }
+  typeLine(&out, "loop_poll_wait_seconds", "summary");
+  for (size_t i = 0; i < c.loops.size(); ++i)
+  {
+    summary(&out, "loop_poll_wait_seconds", labels[i], c.loops[i].metrics.pollWaitNs, ns);
+  }
+  typeLine(&out, "loop_channel_seconds", "summary");
+  for (size_t i = 0; i < c.loops.size(); ++i)
+  {
+    summary(&out, "loop_channel_seconds", labels[i], c.loops[i].metrics.channelNs, ns);
+  }
+  typeLine(&out, "loop_functor_seconds", "summary");
+  for (size_t i = 0; i < c.loops.size(); ++i)
+  {
+    summary(&out, "loop_functor_seconds", labels[i], c.loops[i].metrics.functorNs, ns);
+  }
+  typeLine(&out, "loop_pending_functors", "summary");
+  for (size_t i = 0; i < c.loops.size(); ++i)
+  {
+    summary(&out, "loop_pending_functors", labels[i], c.loops[i].metrics.pendingFunctors, 1);
+  }
+  typeLine(&out, "loop_active_channels", "summary");
+  for (size_t i = 0; i < c.loops.size(); ++i)
+  {
+    summary(&out, "loop_active_channels", labels[i], c.loops[i].metrics.activeChannels, 1);
+  }
+  typeLine(&out, "loop_socket_queue_seconds", "summary");
+  for (size_t i = 0; i < c.loops.size(); ++i)
+  {
+    summary(&out, "loop_socket_queue_seconds", labels[i], c.loops[i].metrics.socketQueueNs, ns);
+  }
+  typeLine(&out, "loop_dispatch_delay_seconds", "summary");
+  for (size_t i = 0; i < c.loops.size(); ++i)
+  {
+    summary(&out, "loop_dispatch_delay_seconds", labels[i], c.loops[i].metrics.dispatchDelayNs, ns);
+  }
+  return out;
+}
+
+std::string StatsServer::renderJson(const Collection &c) const
+{
+  std::string out;
+  const double us = 1e-3; // JSON里耗时用微秒
+  const ConnectionStats &t = c.traffic;
+  appendf(&out, "{\"server\":\"%s\",\"accepted\":%llu,\"rejected\":%llu,\"connections\":%zu,", escapeJson(target_->name()).c_str(),
+          static_cast<unsigned long long>(c.accepted), static_cast<unsigned long long>(c.rejected), c.connections);
+  appendf(&out, "\"traffic\":{\"bytesRead\":%llu,\"bytesWritten\":%llu,\"readCalls\":%llu,\"writeCalls\":%llu,"
+                "\"highWaterEvents\":%llu,\"outputBufferedUs\":%g,\"zeroCopySends\":%llu,\"zeroCopyBytes\":%llu,"
+                "\"zeroCopyCopied\":%llu},",
+          static_cast<unsigned long long>(t.bytesRead), static_cast<unsigned long long>(t.bytesWritten),
+          static_cast<unsigned long long>(t.readCalls), static_cast<unsigned long long>(t.writeCalls),
+          static_cast<unsigned long long>(t.highWaterEvents), t.outputBufferedNs * us,
+          static_cast<unsigned long long>(t.zeroCopySends), static_cast<unsigned long long>(t.zeroCopyBytes),
+          static_cast<unsigned long long>(t.zeroCopyCopied));
+  const MemoryBudget *process = MemoryBudget::process();
+  appendf(&out, "\"bufferMemory\":{\"used\":%lld,\"peak\":%lld,\"limit\":%lld},", static_cast<long long>(process->used()),
+          static_cast<long long>(process->peak()), static_cast<long long>(process->limit()));
+  jsonHistogram(&out, "latencyUs", c.latency, us);
+  out.append(",\"loops\":[");
+  for (size_t i = 0; i < c.loops.size(); ++i)
+  {
+    const LoopSnapshot &l = c.loops[i];
+    appendf(&out, "%s{\"loop\":%zu,\"connections\":%d,\"pendingOutputBytes\":%lld,\"overloaded\":%s,\"iterations\":%llu,"
+                  "\"wakeups\":%llu,\"channelEvents\":%llu,\"functorsRun\":%llu,",
+            i == 0 ? "" : ",", i, l.connections, static_cast<long long>(l.pendingBytes), l.overloaded ? "true" : "false",
+            static_cast<unsigned long long>(l.metrics.iterations), static_cast<unsigned long long>(l.metrics.wakeups),
+            static_cast<unsigned long long>(l.metrics.channelEvents),
+            static_cast<unsigned long long>(l.metrics.functorsRun));
+    appendf(&out, "\"bufferBytes\":%lld,\"bufferLimit\":%lld,\"memoryPaused\":%zu,\"memoryPressureEvents\":%llu,",
+            static_cast<long long>(l.bufferBytes), static_cast<long long>(l.bufferLimit), l.memoryPaused,
+            static_cast<unsigned long long>(l.pressureEvents));
+    jsonHistogram(&out, "pollWaitUs", l.metrics.pollWaitNs, us);
+    out.append(",");
+    jsonHistogram(&out, "channelUs", l.metrics.channelNs, us);
+    out.append(",");
+    jsonHistogram(&out, "functorUs", l.metrics.functorNs, us);
+    out.append(",");
+    jsonHistogram(&out, "pendingFunctors", l.metrics.pendingFunctors, 1);
+    out.append(",");
+    jsonHistogram(&out, "activeChannels", l.metrics.activeChannels, 1);
+    out.append(",");
+    jsonHistogram(&out, "socketQueueUs", l.metrics.socketQueueNs, us);
+    out.append(",");
+    jsonHistogram(&out, "dispatchDelayUs", l.metrics.dispatchDelayNs, us);
+    out.append("}");
+  }
+  out.append("]}\n");
+  return out;
+}
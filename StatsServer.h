@@ -0,0 +1,71 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "TcpServer.h"
+#include "LoopMetrics.h"
+#include "ConnectionStats.h"
+#include "Histogram.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * 内置的指标HTTP服务，监听单独的端口，汇报被监控TcpServer的loop、连接、缓冲区和accept指标
+ *   GET /metrics  Prometheus文本格式
+ *   GET /stats    JSON
+ * 每个请求向各subloop和被监控server的baseloop各投递一个任务，在各自线程里取快照后再投递回来合并，
+ * 数据路径上不加锁。StatsServer自己的连接都在loop上处理，可以直接用被监控server的baseloop。
+ * 有快照超过kCollectTimeout秒没交回时回复503，不让请求一直挂着。
+ */
+class StatsServer : noncopyable
+{
+public:
+  StatsServer(EventLoop *loop, const InetAddress &listenAddr, TcpServer *target);
+
+  void start() { server_.start(); }
+
+private:
+  // 一个subloop的快照，在该loop线程里采集
+  struct LoopSnapshot
+  {
+    LoopMetrics metrics;
+    int connections;
+    int64_t pendingBytes; // outputBuffer里等待发送的字节数
+    bool overloaded;
+    int64_t bufferBytes;     // 连接缓冲区占用的内存，见EventLoop::memoryBudget()
+    int64_t bufferLimit;
+    uint64_t pressureEvents; // 因内存预算用尽暂停读的累计次数
+    size_t memoryPaused;     // 当前暂停读的连接数
+  };
+
+  // 一次请求的采集进度，只在StatsServer的loop线程里修改
+  struct Collection
+  {
+    TcpConnectionPtr conn;
+    bool json;
+    int pending;     // 还没交回快照的任务数
+    bool done;       // 已经回复过(采集完或超时)
+    int64_t timerId; // 超时定时器
+    std::vector<LoopSnapshot> loops;
+    uint64_t accepted;
+    uint64_t rejected;
+    size_t connections;
+    ConnectionStats traffic;
+    Histogram::Snapshot latency;
+  };
+  using CollectionPtr = std::shared_ptr<Collection>;
+
+  void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp);
+  void collect(const TcpConnectionPtr &conn, bool json);
+  void finishOne(const CollectionPtr &c);
+  void timeout(const CollectionPtr &c);
+  void respond(const TcpConnectionPtr &conn, int status, const char *contentType, const std::string &body);
+
+  std::string renderPrometheus(const Collection &c) const;
+  std::string renderJson(const Collection &c) const;
+
+  EventLoop *loop_;
+  TcpServer server_;
+  TcpServer *target_;
+};
@@ -1,15 +1,38 @@
+#define LOG_MODULE Logger::kConnection
+
 #include "TcpConnection.h"
 #include "Logger.h"
 #include "Socket.h"
 #include "Channel.h"
 #include "EventLoop.h"
+#include "MemoryGovernor.h"
+#include "Probes.h"
 
 #include <functional>
+#include <algorithm>
 #include <errno.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <netinet/in.h>
 #include <netinet/tcp.h>
+#include <linux/errqueue.h>
+#include <sys/uio.h>
 #include <string.h>
+#include <unistd.h>
+
+// 老版本的头文件里没有零拷贝相关的定义
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+#define SO_EE_ORIGIN_ZEROCOPY 5
+#endif
+#ifndef SO_EE_CODE_ZEROCOPY_COPIED
+#define SO_EE_CODE_ZEROCOPY_COPIED 1
+#endif
 
 // 判断构造函数传入的loop是否为空
 static EventLoop *CheckLoopNotNull(EventLoop *loop)
@@ -21,20 +44,53 @@ static EventLoop *CheckLoopNotNull(EventLoop *loop)
   return loop;
 }
 
+// 计数只有所属loop线程写，不需要原子的读改写
+static void addTo(std::atomic<uint64_t> &counter, uint64_t delta)
+{
+  counter.store(counter.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+}
+
 TcpConnection::TcpConnection(EventLoop *loop,
                              const std::string &nameArg,
                              int sockfd,
                              const InetAddress &localAddr,
-                             const InetAddress &peerAddr)
+                             const InetAddress &peerAddr,
+                             uint64_t id)
     : loop_(CheckLoopNotNull(loop)),
       name_(nameArg),
+      id_(id),
       state_(kConnecting),
       reading_(true),
       socket_(new Socket(sockfd)),
       channel_(new Channel(loop, sockfd)),
       localAddr_(localAddr),
       peerAddr_(peerAddr),
-      highWaterMark_(64 * 1024 * 1024) // 64M高水位控制收发速度
+      highWaterMark_(64 * 1024 * 1024), // 64M高水位控制收发速度
+      payloadBytes_(0),
+      zeroCopyThreshold_(0),
+      nextZeroCopyId_(0),
+      migrating_(false),
+      bytesRead_(0),
+      bytesWritten_(0),
+      readCalls_(0),
+      writeCalls_(0),
+      highWaterEvents_(0),
+      outputBufferedNs_(0),
+      bufferedSinceNs_(0),
+      zeroCopySends_(0),
+      zeroCopyBytes_(0),
+      zeroCopyCopied_(0),
+      receiveTimestamps_(false),
+      fairnessBudget_(0),
+      resumeQueued_(false),
+      shapingRegistered_(false),
+      readThrottled_(false),
+      writeThrottled_(false),
+      closeOnMemoryPressure_(false),
+      memoryPaused_(false),
+      sendRingDirty_(false),
+      sendRingBypass_(0),
+      nextSendRing_(nullptr)
 
 {
   // 给channel设置相应回调，poller监听到channel感兴趣的事件发生了，channel会回调相应的操作函数
@@ -42,23 +98,308 @@ TcpConnection::TcpConnection(EventLoop *loop,
   channel_->setWriteCallback(std::bind(&TcpConnection::handleWrite, this));
   channel_->setCloseCallback(std::bind(&TcpConnection::handleClose, this));
   channel_->setErrorCallback(std::bind(&TcpConnection::handleError, this));
+  inputBuffer_.setBudget(loop->memoryBudget());
+  outputBuffer_.setBudget(loop->memoryBudget());
   LOG_INFO("TcpConnection::ctor[%s] at fd=%d \n", name_.c_str(), sockfd);
   socket_->setKeepAlive(true);
 }
 
 TcpConnection::~TcpConnection()
 {
+  if (tenant_)
+  {
+    --tenant_->members;
+  }
   LOG_INFO("TcpConnection::dtor[%s] at fd=%d state=%d\n", name_.c_str(), channel_->fd(), (int)state_);
 }
 
+ConnectionStats TcpConnection::stats() const
+{
+  ConnectionStats s;
+  s.connections = 1;
+  s.bytesRead = bytesRead_.load(std::memory_order_relaxed);
+  s.bytesWritten = bytesWritten_.load(std::memory_order_relaxed);
+  s.readCalls = readCalls_.load(std::memory_order_relaxed);
+  s.writeCalls = writeCalls_.load(std::memory_order_relaxed);
+  s.highWaterEvents = highWaterEvents_.load(std::memory_order_relaxed);
+  s.outputBufferedNs = outputBufferedNs_.load(std::memory_order_relaxed);
+  s.zeroCopySends = zeroCopySends_.load(std::memory_order_relaxed);
+  s.zeroCopyBytes = zeroCopyBytes_.load(std::memory_order_relaxed);
+  s.zeroCopyCopied = zeroCopyCopied_.load(std::memory_order_relaxed);
+  int64_t since = bufferedSinceNs_.load(std::memory_order_relaxed);
+  if (since != 0)
+  {
+    // 还没发完的这一段也算上
+    int64_t now = Timestamp::monotonicNanos();
+    s.outputBufferedNs += now > since ? now - since : 0;
+  }
+  return s;
+}
+
+void TcpConnection::enableLatencyHistogram()
+{
+  if (!latency_)
+  {
+    latency_.reset(new Histogram);
+  }
+}
+
+Histogram::Snapshot TcpConnection::latencySnapshot() const
+{
+  return latency_ ? latency_->snapshot() : Histogram::Snapshot();
+}
+
+void TcpConnection::enableReceiveTimestamps()
+{
+  receiveTimestamps_ = socket_->setReceiveTimestamps(true);
+}
+
+void TcpConnection::setReadRateLimit(double rate, double burst)
+{
+  readBucket_.reset(rate > 0 ? new TokenBucket(rate, burst) : nullptr);
+  registerShaping();
+}
+
+void TcpConnection::setWriteRateLimit(double rate, double burst)
+{
+  writeBucket_.reset(rate > 0 ? new TokenBucket(rate, burst) : nullptr);
+  registerShaping();
+}
+
+void TcpConnection::setTenant(const std::string &name)
+{
+  if (tenant_)
+  {
+    --tenant_->members;
+  }
+  tenantName_ = name;
+  tenant_ = name.empty() ? nullptr : getLoop()->trafficShaper()->tenant(name);
+  if (tenant_)
+  {
+    ++tenant_->members;
+  }
+  registerShaping();
+}
+
+void TcpConnection::registerShaping()
+{
+  if (!shapingRegistered_)
+  {
+    shapingRegistered_ = true;
+    getLoop()->trafficShaper()->add(shared_from_this());
+  }
+}
+
+size_t TcpConnection::readAllowance() const
+{
+  size_t allow = static_cast<size_t>(-1);
+  if (readBucket_)
+  {
+    allow = std::min(allow, readBucket_->available());
+  }
+  if (tenant_ && tenant_->read)
+  {
+    allow = std::min(allow, std::min(tenant_->read->available(), tenant_->share(*tenant_->read)));
+  }
+  return allow;
+}
+
+size_t TcpConnection::writeAllowance() const
+{
+  size_t allow = static_cast<size_t>(-1);
+  if (writeBucket_)
+  {
+    allow = std::min(allow, writeBucket_->available());
+  }
+  if (tenant_ && tenant_->write)
+  {
+    allow = std::min(allow, std::min(tenant_->write->available(), tenant_->share(*tenant_->write)));
+  }
+  return allow;
+}
+
+void TcpConnection::consumeWriteTokens(size_t n)
+{
+  if (writeShaped())
+  {
+    if (writeBucket_)
+    {
+      writeBucket_->consume(n);
+    }
+    if (tenant_ && tenant_->write)
+    {
+      tenant_->write->consume(n);
+    }
+    getLoop()->trafficShaper()->activate();
+  }
+}
+
+bool TcpConnection::refillShaping(double seconds)
+{
+  bool busy = readThrottled_ || writeThrottled_;
+  if (readBucket_)
+  {
+    readBucket_->refill(seconds);
+    busy = busy || !readBucket_->full();
+  }
+  if (writeBucket_)
+  {
+    writeBucket_->refill(seconds);
+    busy = busy || !writeBucket_->full();
+  }
+  return busy;
+}
+
+void TcpConnection::resumeShaping()
+{
+  if (readThrottled_ && readAllowance() > 0)
+  {
+    readThrottled_ = false;
+    if (state_ == kConnected && !memoryPaused_)
+    {
+      channel_->enableReading();
+    }
+  }
+  if (writeThrottled_ && writeAllowance() > 0)
+  {
+    writeThrottled_ = false;
+    if (outputBytes() > 0)
+    {
+      channel_->enableWriting();
+    }
+    else if (state_ == kDisconnecting)
+    {
+      shutdownInLoop();
+    }
+  }
+}
+
+void TcpConnection::resumeFromMemoryPressure()
+{
+  if (memoryPaused_)
+  {
+    memoryPaused_ = false;
+    if (state_ == kConnected && !readThrottled_)
+    {
+      channel_->enableReading();
+    }
+  }
+}
+
+bool TcpConnection::checkMemoryPressure()
+{
+  EventLoop *loop = getLoop();
+  MemoryBudget *budget = loop->memoryBudget();
+  if (memoryPaused_ || !budget->exhausted())
+  {
+    return false;
+  }
+  // 只暂停占用不低于本loop平均值的连接，小连接照常服务
+  const size_t footprint = bufferFootprint();
+  const int64_t conns = std::max(loop->connectionCount(), 1);
+  if (static_cast<int64_t>(footprint) * conns < budget->used())
+  {
+    return false;
+  }
+
+  memoryPaused_ = true;
+  budget->countPressureEvent();
+  if (channel_->isReading())
+  {
+    channel_->disableReading();
+  }
+  loop->memoryGovernor()->add(shared_from_this());
+  LOG_INFO("TcpConnection::checkMemoryPressure [%s] - paused reading, buffers %lu bytes, loop %lld/%lld, process %lld/%lld \n",
+           name_.c_str(), footprint, static_cast<long long>(budget->used()), static_cast<long long>(budget->limit()),
+           static_cast<long long>(MemoryBudget::process()->used()), static_cast<long long>(MemoryBudget::process()->limit()));
+  if (memoryPressureCallback_)
+  {
+    memoryPressureCallback_(shared_from_this(), footprint);
+  }
+  if (closeOnMemoryPressure_)
+  {
+    // 可能在应用的回调里，推迟到回调返回之后
+    queueInLoop(std::bind(&TcpConnection::forceCloseInLoop, shared_from_this()));
+  }
+  return true;
+}
+
+void TcpConnection::releaseIdleBuffer(Buffer *buffer)
+{
+  if (buffer->readableBytes() == 0 && !getLoop()->memoryBudget()->relieved())
+  {
+    buffer->shrink();
+  }
+}
+
+void TcpConnection::forceCloseInLoop()
+{
+  if (state_ == kConnected || state_ == kDisconnecting)
+  {
+    handleClose();
+  }
+}
+
 void TcpConnection::handleRead(Timestamp recevieTime)
 {
+  if (memoryPaused_ || checkMemoryPressure())
+  {
+    return;
+  }
+
+  size_t budget = fairnessBudget_;
+  if (readShaped())
+  {
+    size_t allow = readAllowance();
+    if (allow == 0)
+    {
+      // 令牌用完，等TrafficShaper补充后再恢复读
+      readThrottled_ = true;
+      channel_->disableReading();
+      getLoop()->trafficShaper()->activate();
+      return;
+    }
+    if (budget == 0 || allow < budget)
+    {
+      budget = allow;
+    }
+  }
+
   int savedErrno = 0;
-  ssize_t n = inputBuffer_.readFd(channel_->fd(), &savedErrno);
+  ssize_t n = 0;
+  if (receiveTimestamps_)
+  {
+    n = inputBuffer_.readFd(channel_->fd(), &savedErrno, &kernelReceiveTime_, budget);
+    if (n > 0 && kernelReceiveTime_.valid())
+    {
+      int64_t now = Timestamp::now().microSecondsSinceEpoch();
+      int64_t polled = recevieTime.microSecondsSinceEpoch();
+      getLoop()->recordReceiveDelay((polled - kernelReceiveTime_.microSecondsSinceEpoch()) * 1000,
+                                    (now - polled) * 1000);
+    }
+  }
+  else
+  {
+    n = inputBuffer_.readFd(channel_->fd(), &savedErrno, budget);
+  }
+  addTo(readCalls_, 1);
   if (n > 0)
   {
+    addTo(bytesRead_, n);
+    if (readShaped())
+    {
+      if (readBucket_)
+      {
+        readBucket_->consume(n);
+      }
+      if (tenant_ && tenant_->read)
+      {
+        tenant_->read->consume(n);
+      }
+      getLoop()->trafficShaper()->activate();
+    }
     // 已建立连接的用户有可读事件发生了，调用用户传入的onMessage
-    messageCallback_(shared_from_this(), &inputBuffer_, recevieTime);
+    deliverMessage(recevieTime);
   }
   else if (n == 0)
   {
@@ -74,24 +415,75 @@ void TcpConnection::handleRead(Timestamp recevieTime)
   }
 }
 
+void TcpConnection::deliverMessage(Timestamp receiveTime)
+{
+  const size_t before = inputBuffer_.readableBytes();
+  messageCallback_(shared_from_this(), &inputBuffer_, receiveTime);
+  const size_t after = inputBuffer_.readableBytes();
+  releaseIdleBuffer(&inputBuffer_);
+  // 应用用完了本次的处理预算：有消费但没消费完，排到本轮其他channel后面再处理剩下的
+  // 没有消费说明剩下的不是完整消息，等新数据
+  if (fairnessBudget_ > 0 && !resumeQueued_ && after > 0 && after < before && state_ == kConnected)
+  {
+    resumeQueued_ = true;
+    queueInLoop(std::bind(&TcpConnection::resumeMessage, shared_from_this(), receiveTime));
+  }
+}
+
+void TcpConnection::resumeMessage(Timestamp receiveTime)
+{
+  resumeQueued_ = false;
+  if (state_ == kConnected && inputBuffer_.readableBytes() > 0)
+  {
+    deliverMessage(receiveTime);
+  }
+}
+
 void TcpConnection::handleWrite()
 {
   int savedErrno = 0;
   if (channel_->isWriting())
   {
-    ssize_t n = outputBuffer_.writeFd(channel_->fd(), &savedErrno);
+    size_t allow = 0;
+    if (writeShaped())
+    {
+      allow = writeAllowance();
+      if (allow == 0)
+      {
+        // 令牌用完，等TrafficShaper补充后再恢复写
+        writeThrottled_ = true;
+        channel_->disableWriting();
+        getLoop()->trafficShaper()->activate();
+        return;
+      }
+    }
+    ssize_t n = outputChain_.empty() ? outputBuffer_.writeFd(channel_->fd(), &savedErrno, allow)
+                                     : writeOutputChain(&savedErrno, allow);
+    addTo(writeCalls_, 1);
     if (n > 0)
     {
-      outputBuffer_.retrieve(n);
-      if (outputBuffer_.readableBytes() == 0)
+      addTo(bytesWritten_, n);
+      consumeWriteTokens(n);
+      if (outputChain_.empty())
       {
+        outputBuffer_.retrieve(n);
+      }
+      else
+      {
+        retrieveOutputChain(n);
+      }
+      getLoop()->adjustPendingBytes(-n);
+      if (outputBytes() == 0)
+      {
+        addTo(outputBufferedNs_, Timestamp::monotonicNanos() - bufferedSinceNs_.load(std::memory_order_relaxed));
+        bufferedSinceNs_.store(0, std::memory_order_relaxed);
         // 数据发送完后变为不可写
-        channel_->disableReading();
+        channel_->disableWriting();
+        releaseIdleBuffer(&outputBuffer_);
         if (writeCompleteCallback_)
         {
           // 唤醒loop对应的thread线程，执行回调
-          loop_->queueInLoop(
-              std::bind(writeCompleteCallback_, shared_from_this()));
+          queueInLoop(std::bind(writeCompleteCallback_, shared_from_this()));
         }
       }
       if (state_ == kDisconnecting)
@@ -118,11 +510,19 @@ void TcpConnection::handleClose()
   channel_->disableAll();
 
   TcpConnectionPtr connPtr(shared_from_this());
-  connectionCallback_(connPtr); // 执行连接关闭的回调
+  if (connectionCallback_)
+  {
+    connectionCallback_(connPtr); // 执行连接关闭的回调
+  }
   closeCallback_(connPtr);      // 关闭连接的回调,执行的是TcpServer::removeConnection
 }
 void TcpConnection::handleError()
 {
+  const bool zeroCopy = zeroCopyThreshold_ > 0 || !zeroCopyPins_.empty();
+  if (zeroCopy)
+  {
+    reapZeroCopy();
+  }
   int optval;
   socklen_t optlen = sizeof optval;
   int err = 0;
@@ -134,36 +534,305 @@ void TcpConnection::handleError()
   {
     err = optval;
   }
+  if (err == 0 && zeroCopy)
+  {
+    return; // 只是零拷贝的完成通知
+  }
   LOG_ERROR("TcpConnection::handleError name:%s -SO_ERROR:%d \n", name_.c_str(), err);
 }
 
+bool TcpConnection::enableZeroCopy(size_t threshold)
+{
+  if (threshold > 0 && zeroCopyThreshold_ == 0)
+  {
+    int on = 1;
+    if (::setsockopt(channel_->fd(), SOL_SOCKET, SO_ZEROCOPY, &on, sizeof on) < 0)
+    {
+      LOG_ERROR("TcpConnection::enableZeroCopy [%s] - SO_ZEROCOPY err:%d \n", name_.c_str(), errno);
+      return false;
+    }
+  }
+  zeroCopyThreshold_ = threshold;
+  return true;
+}
+
+ssize_t TcpConnection::writeZeroCopy(const Payload &payload, size_t len)
+{
+  struct iovec vec;
+  vec.iov_base = const_cast<char *>(payload.data());
+  vec.iov_len = len;
+  struct msghdr msg;
+  memset(&msg, 0, sizeof msg);
+  msg.msg_iov = &vec;
+  msg.msg_iovlen = 1;
+  ssize_t n = ::sendmsg(channel_->fd(), &msg, MSG_ZEROCOPY);
+  if (n > 0)
+  {
+    // 内核按sendmsg的次数编号，完成通知里给的是编号区间
+    zeroCopyPins_.push_back(ZeroCopyPin{nextZeroCopyId_++, payload.slice(0, n)});
+    addTo(zeroCopySends_, 1);
+    addTo(zeroCopyBytes_, n);
+  }
+  else if (n < 0 && errno == ENOBUFS)
+  {
+    // 锁住的页超过了optmem_max，这次退回拷贝
+    n = ::write(channel_->fd(), payload.data(), len);
+  }
+  return n;
+}
+
+void TcpConnection::reapZeroCopy()
+{
+  for (;;)
+  {
+    char control[128];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof msg);
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof control;
+    if (::recvmsg(channel_->fd(), &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+    {
+      break; // EAGAIN，通知读完了
+    }
+    for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm != nullptr; cm = CMSG_NXTHDR(&msg, cm))
+    {
+      if (!(cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) &&
+          !(cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR))
+      {
+        continue;
+      }
+      const struct sock_extended_err *err = reinterpret_cast<const struct sock_extended_err *>(CMSG_DATA(cm));
+      if (err->ee_errno != 0 || err->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+      {
+        continue;
+      }
+      // 编号在[lo, hi]里的发送都完成了，编号是32位的，会回绕
+      const uint32_t lo = err->ee_info;
+      const uint32_t hi = err->ee_data;
+      if (err->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+      {
+        addTo(zeroCopyCopied_, hi - lo + 1);
+      }
+      zeroCopyPins_.erase(std::remove_if(zeroCopyPins_.begin(), zeroCopyPins_.end(),
+                                         [lo, hi](const ZeroCopyPin &pin)
+                                         { return pin.id - lo <= hi - lo; }),
+                          zeroCopyPins_.end());
+    }
+  }
+}
+
 void TcpConnection::send(const std::string &buf)
 {
   if (state_ == kConnected)
   {
-    if (loop_->isInLoopThread())
+    if (getLoop()->isInLoopThread() && !migrating_)
     {
+      drainSendRing();
       sendInLoop(buf.c_str(), buf.size());
     }
+    else if (sendRing_ && sendRingBypass_.load(std::memory_order_acquire) == 0 &&
+             sendRing_->tryWrite(buf.data(), buf.size()))
+    {
+      // 和handleSendRing里的清除配对：要么loop这次会读到刚提交的数据，要么这里重新挂上
+      if (!sendRingDirty_.exchange(true, std::memory_order_seq_cst))
+      {
+        sendRingHold_ = shared_from_this();
+        getLoop()->queueSendRing(this);
+      }
+    }
+    else
+    {
+      // 跨线程发送时buf可能在回调执行前就析构了，拷贝一份
+      TcpConnectionPtr self(shared_from_this());
+      if (sendRing_)
+      {
+        sendRingBypass_.fetch_add(1, std::memory_order_acq_rel);
+      }
+      queueInLoop([self, buf]()
+                  { self->sendQueued(buf.c_str(), buf.size(), nullptr); });
+    }
+  }
+}
+
+void TcpConnection::send(const Payload &payload)
+{
+  if (state_ == kConnected && !payload.empty())
+  {
+    if (getLoop()->isInLoopThread() && !migrating_)
+    {
+      drainSendRing();
+      sendInLoop(payload.data(), payload.size(), &payload);
+    }
     else
     {
+      // 只拷贝引用
+      TcpConnectionPtr self(shared_from_this());
+      if (sendRing_)
+      {
+        sendRingBypass_.fetch_add(1, std::memory_order_acq_rel);
+      }
+      queueInLoop([self, payload]()
+                  { self->sendQueued(payload.data(), payload.size(), &payload); });
+    }
+  }
+}
 
-      loop_->runInLoop(std::bind(
-          &TcpConnection::sendInLoop,
-          this,
-          buf.c_str(),
-          buf.size()));
+void TcpConnection::sendQueued(const void *data, size_t len, const Payload *payload)
+{
+  if (sendRing_)
+  {
+    drainSendRing();
+    sendInLoop(data, len, payload);
+    sendRingBypass_.fetch_sub(1, std::memory_order_acq_rel);
+  }
+  else
+  {
+    sendInLoop(data, len, payload);
+  }
+}
+
+void TcpConnection::enableSendRing(size_t capacity)
+{
+  sendRing_.reset(new SendRing(capacity));
+}
+
+void TcpConnection::handleSendRing()
+{
+  TcpConnectionPtr self;
+  self.swap(sendRingHold_);
+  sendRingDirty_.store(false, std::memory_order_seq_cst);
+  if (getLoop()->isInLoopThread() && !migrating_)
+  {
+    drainSendRing();
+  }
+  else
+  {
+    // 挂上之后连接迁走了，转交给新loop
+    queueInLoop(std::bind(&TcpConnection::drainSendRing, self));
+  }
+}
+
+void TcpConnection::drainSendRing()
+{
+  if (!sendRing_)
+  {
+    return;
+  }
+  // 只取本次调用时已提交的部分(绕回时是两段)，生产者一直在写也不会在这里停不下来
+  size_t remaining = sendRing_->readableBytes();
+  while (remaining > 0)
+  {
+    size_t len = 0;
+    const char *data = sendRing_->peek(&len);
+    len = std::min(len, remaining);
+    // 已经断开时直接丢弃
+    if (state_ != kDisconnected)
+    {
+      sendInLoop(data, len);
+    }
+    sendRing_->retrieve(len);
+    remaining -= len;
+  }
+}
+
+ssize_t TcpConnection::writeOutputChain(int *savedErrno, size_t maxBytes)
+{
+  const Payload &head = outputChain_.front().payload;
+  if (zeroCopyEligible(head))
+  {
+    ssize_t n = writeZeroCopy(head, maxBytes > 0 ? std::min(maxBytes, head.size()) : head.size());
+    MYMUDUO_PROBE2(buffer_write, channel_->fd(), n);
+    if (n < 0)
+    {
+      *savedErrno = errno;
+    }
+    return n;
+  }
+
+  const int kMaxIov = 64;
+  struct iovec vec[kMaxIov];
+  int iovcnt = 0;
+  size_t total = 0;
+  size_t bufferOffset = 0; // outputBuffer_里已经放进vec的字节数
+  for (auto it = outputChain_.begin(); it != outputChain_.end() && iovcnt < kMaxIov; ++it)
+  {
+    if (zeroCopyEligible(it->payload))
+    {
+      break; // 下次单独用MSG_ZEROCOPY发
+    }
+    const char *base = nullptr;
+    size_t len = 0;
+    if (it->payload.empty())
+    {
+      base = outputBuffer_.peek() + bufferOffset;
+      len = it->bufferBytes;
+      bufferOffset += len;
+    }
+    else
+    {
+      base = it->payload.data();
+      len = it->payload.size();
+    }
+    if (maxBytes > 0 && total + len > maxBytes)
+    {
+      len = maxBytes - total;
+    }
+    vec[iovcnt].iov_base = const_cast<char *>(base);
+    vec[iovcnt].iov_len = len;
+    ++iovcnt;
+    total += len;
+    if (maxBytes > 0 && total == maxBytes)
+    {
+      break;
+    }
+  }
+  ssize_t n = ::writev(channel_->fd(), vec, iovcnt);
+  MYMUDUO_PROBE2(buffer_write, channel_->fd(), n);
+  if (n < 0)
+  {
+    *savedErrno = errno;
+  }
+  return n;
+}
+
+void TcpConnection::retrieveOutputChain(size_t len)
+{
+  while (len > 0 && !outputChain_.empty())
+  {
+    OutputSegment &segment = outputChain_.front();
+    size_t n = 0;
+    if (segment.payload.empty())
+    {
+      n = std::min(len, segment.bufferBytes);
+      outputBuffer_.retrieve(n);
+      segment.bufferBytes -= n;
+    }
+    else
+    {
+      n = std::min(len, segment.payload.size());
+      segment.payload.retrieve(n); // 发完时释放对数据块的引用
+      payloadBytes_ -= n;
+    }
+    len -= n;
+    if (segment.payload.empty() && segment.bufferBytes == 0)
+    {
+      outputChain_.pop_front();
     }
   }
+  if (payloadBytes_ == 0)
+  {
+    // 只剩outputBuffer_里的数据，回到普通的发送方式
+    outputChain_.clear();
+  }
 }
 
 /**
  * 发送数据，应用写的快，而内核发送的慢，需要把发送数据写入缓冲区，而且设置了水位回调
  */
-void TcpConnection::sendInLoop(const void *data, size_t len)
+void TcpConnection::sendInLoop(const void *data, size_t len, const Payload *payload)
 {
   ssize_t nwrote = 0;
-  size_t remaining = 0;
+  size_t remaining = len; // 正在写或缓冲区里还有数据时整个追加到outputBuffer后面
   bool faultError = false;
 
   // 之前调用过Connection的shutdown，不能再发送了
@@ -174,17 +843,27 @@ void TcpConnection::sendInLoop(const void *data, size_t len)
   }
 
   // 表示channel_第一次开始写数据（最开始对读事件不感兴趣），而且缓冲区没有待发送数据
-  if (!channel_->isWriting() && outputBuffer_.readableBytes() == 0)
+  size_t allow = writeShaped() ? writeAllowance() : len;
+  if (allow == 0)
   {
-    nwrote = ::write(channel_->fd(), data, len);
+    // 写令牌用完，整个放进outputBuffer，等TrafficShaper恢复
+    writeThrottled_ = true;
+    getLoop()->trafficShaper()->activate();
+  }
+  else if (!channel_->isWriting() && !writeThrottled_ && outputBytes() == 0)
+  {
+    nwrote = payload != nullptr && zeroCopyEligible(*payload) ? writeZeroCopy(*payload, std::min(len, allow))
+                                                              : ::write(channel_->fd(), data, std::min(len, allow));
+    addTo(writeCalls_, 1);
     if (nwrote >= 0)
     {
+      addTo(bytesWritten_, nwrote);
+      consumeWriteTokens(nwrote);
       remaining = len - nwrote;
       if (remaining == 0 && writeCompleteCallback_)
       {
         // 数据全部发送完成，就不用再给channel设置epollout事件了
-        loop_->queueInLoop(
-            std::bind(writeCompleteCallback_, shared_from_this()));
+        queueInLoop(std::bind(writeCompleteCallback_, shared_from_this()));
       }
     }
     else
@@ -208,30 +887,74 @@ void TcpConnection::sendInLoop(const void *data, size_t len)
   if (!faultError && remaining > 0)
   {
     // 目前发送缓冲区剩余的待发送数据的长度
-    size_t oldlen = outputBuffer_.readableBytes();
-    if (oldlen + remaining >= highWaterMark_ && oldlen < highWaterMark_ && highWaterMark_)
+    size_t oldlen = outputBytes();
+    if (oldlen + remaining >= highWaterMark_ && oldlen < highWaterMark_)
+    {
+      addTo(highWaterEvents_, 1);
+      MYMUDUO_PROBE2(high_water, channel_->fd(), oldlen + remaining);
+      if (highWaterMarkCallback_)
+      {
+        queueInLoop(std::bind(highWaterMarkCallback_, shared_from_this(), oldlen + remaining));
+      }
+    }
+    if (oldlen == 0)
     {
-      loop_->queueInLoop(
-          std::bind(highWaterMarkCallback_, shared_from_this(), oldlen + remaining));
+      bufferedSinceNs_.store(Timestamp::monotonicNanos(), std::memory_order_relaxed);
     }
 
-    outputBuffer_.append((char *)data + nwrote, remaining);
-    if (!channel_->isWriting())
+    if (payload != nullptr)
+    {
+      // 之前排队的都在outputBuffer_里，先记下它们的位置
+      if (outputChain_.empty() && outputBuffer_.readableBytes() > 0)
+      {
+        outputChain_.push_back(OutputSegment{Payload(), outputBuffer_.readableBytes()});
+      }
+      outputChain_.push_back(OutputSegment{payload->slice(nwrote, remaining), 0});
+      payloadBytes_ += remaining;
+    }
+    else
+    {
+      outputBuffer_.append((char *)data + nwrote, remaining);
+      if (!outputChain_.empty())
+      {
+        if (outputChain_.back().payload.empty())
+        {
+          outputChain_.back().bufferBytes += remaining;
+        }
+        else
+        {
+          outputChain_.push_back(OutputSegment{Payload(), remaining});
+        }
+      }
+    }
+    getLoop()->adjustPendingBytes(remaining);
+    if (!channel_->isWriting() && !writeThrottled_)
     {
       channel_->enableWriting(); // 这里一定要注册channel的写事件
     }
+    checkMemoryPressure();
   }
 }
 
 // 连接建立
 void TcpConnection::connectEstablised()
 {
+  if (getLoop()->numaLocalMemory())
+  {
+    // 构造时在baseloop线程分配的缓冲区在loop线程里重新分配，first touch让内存落在本loop的NUMA节点
+    Buffer(Buffer::kInitalSize).swap(inputBuffer_);
+    Buffer(Buffer::kInitalSize).swap(outputBuffer_);
+  }
   setState(kConnected);
   channel_->tie(shared_from_this());
   channel_->enableReading(); // 向poller注册channel的读事件
+  MYMUDUO_PROBE3(conn_established, channel_->fd(), this, name_.c_str());
 
   // 新连接建立，执行回调
-  connectionCallback_(shared_from_this());
+  if (connectionCallback_)
+  {
+    connectionCallback_(shared_from_this());
+  }
 }
 
 // 连接销毁
@@ -245,6 +968,15 @@ void TcpConnection::connectDestroyed()
     }
   }
   channel_->remove(); // channel从poller中删除掉
+  MYMUDUO_PROBE3(conn_destroyed, channel_->fd(), bytesRead_.load(std::memory_order_relaxed),
+                 bytesWritten_.load(std::memory_order_relaxed));
+
+  getLoop()->adjustConnectionCount(-1);
+  getLoop()->adjustPendingBytes(-static_cast<int64_t>(outputBytes()));
+  // 连接对象可能比loop活得久(用户还持有TcpConnectionPtr)，缓冲区的计账挪到进程级预算上，
+  // 之后析构时不会再碰已经不存在的loop预算
+  inputBuffer_.setBudget(MemoryBudget::process());
+  outputBuffer_.setBudget(MemoryBudget::process());
 }
 
 // 关闭连接
@@ -253,15 +985,155 @@ void TcpConnection::shutdown()
   if (state_ == kConnected)
   {
     setState(kDisconnecting);
-    loop_->runInLoop(
-        std::bind(&TcpConnection::shutdownInLoop, this));
+    queueInLoop(std::bind(&TcpConnection::shutdownInLoop, shared_from_this()));
   }
 }
 
 void TcpConnection::shutdownInLoop()
 {
-  if (!channel_->isWriting()) // 说明当前outputbuffer已经全部发送完成
+  drainSendRing(); // shutdown之前写进发送环的数据
+  if (!channel_->isWriting() && !writeThrottled_) // 说明当前outputbuffer已经全部发送完成
   {
     socket_->shutdownWrite(); // 关闭写端
   }
+}
+
+void TcpConnection::queueInLoop(std::function<void()> cb)
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (migrating_)
+  {
+    backlog_.push_back(std::move(cb));
+  }
+  else
+  {
+    getLoop()->queueInLoop(std::move(cb));
+  }
+}
+
+bool TcpConnection::migrateTo(EventLoop *target)
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (migrating_ || target == getLoop())
+  {
+    return false;
+  }
+  // 此前投递到原loop的任务都排在migrateInLoop前面，此后的任务进backlog_
+  migrating_ = true;
+  getLoop()->queueInLoop(std::bind(&TcpConnection::migrateInLoop, shared_from_this(), target));
+  return true;
+}
+
+// 在原loop线程中执行
+void TcpConnection::migrateInLoop(EventLoop *target)
+{
+  EventLoop *loop = getLoop();
+  if (!loop->hasChannel(channel_.get()))
+  {
+    // connectDestroyed已经执行过了，没有可迁移的
+    std::vector<std::function<void()>> functors;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      functors.swap(backlog_);
+      migrating_ = false;
+    }
+    for (const auto &functor : functors)
+    {
+      functor();
+    }
+    return;
+  }
+
+  bool reading = channel_->isReading();
+  bool writing = channel_->isWriting();
+  channel_->disableAll();
+  channel_->remove(); // 从原loop的poller中摘下来
+  // 连接数在选定目标loop时就转过去，和TcpServer::establishConnection一样，不等attachInLoop
+  loop->adjustConnectionCount(-1);
+  target->adjustConnectionCount(1);
+  loop->adjustPendingBytes(-static_cast<int64_t>(outputBytes()));
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  channel_->setOwnerLoop(target);
+  loop_.store(target, std::memory_order_release);
+  target->queueInLoop(std::bind(&TcpConnection::attachInLoop, shared_from_this(), reading, writing));
+}
+
+// 在新loop线程中执行
+void TcpConnection::attachInLoop(bool reading, bool writing)
+{
+  EventLoop *loop = getLoop();
+  loop->adjustPendingBytes(outputBytes());
+  inputBuffer_.setBudget(loop->memoryBudget());
+  outputBuffer_.setBudget(loop->memoryBudget());
+  if (memoryPaused_)
+  {
+    loop->memoryGovernor()->add(shared_from_this());
+  }
+  if (state_ == kConnected || state_ == kDisconnecting)
+  {
+    if (reading)
+    {
+      channel_->enableReading();
+    }
+    if (writing)
+    {
+      channel_->enableWriting();
+    }
+  }
+  if (shapingRegistered_)
+  {
+    // 限速状态跟着连接走，租户桶换成新loop上的同名租户
+    shapingRegistered_ = false;
+    if (tenant_)
+    {
+      --tenant_->members;
+      tenant_ = loop->trafficShaper()->tenant(tenantName_);
+      ++tenant_->members;
+    }
+    registerShaping();
+    if (readThrottled_ || writeThrottled_)
+    {
+      loop->trafficShaper()->activate();
+    }
+  }
+
+  // 迁移期间积压的任务按投递顺序执行，之后的任务直接投递到新loop
+  std::vector<std::function<void()>> functors;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    functors.swap(backlog_);
+    migrating_ = false;
+  }
+  for (const auto &functor : functors)
+  {
+    functor();
+  }
+}
+
+int TcpConnection::detachIfIdle()
+{
+  if (!zeroCopyPins_.empty())
+  {
+    reapZeroCopy();
+  }
+  // 还有零拷贝的完成通知没到时不交出去，通知会落到新进程的socket上
+  if (state_ != kConnected || migrating_ ||
+      inputBuffer_.readableBytes() != 0 || outputBytes() != 0 || !zeroCopyPins_.empty())
+  {
+    return -1;
+  }
+  int fd = ::dup(channel_->fd());
+  if (fd < 0)
+  {
+    LOG_ERROR("TcpConnection::detachIfIdle dup err:%d \n", errno);
+    return -1;
+  }
+  setState(kDisconnected);
+  channel_->disableAll();
+  if (connectionCallback_)
+  {
+    connectionCallback_(shared_from_this());
+  }
+  return fd;
 }
\ No newline at end of file
@@ -5,10 +5,19 @@
 #include "Callbacks.h"
 #include "Buffer.h"
 #include "Timestamp.h"
+#include "Histogram.h"
+#include "ConnectionStats.h"
+#include "TrafficShaper.h"
+#include "Payload.h"
+#include "SendRing.h"
 
 #include <memory>
 #include <string>
 #include <atomic>
+#include <deque>
+#include <mutex>
+#include <vector>
+#include <functional>
 
 class Channel;
 class EventLoop;
@@ -25,12 +34,16 @@ public:
                 const std::string &nameArg,
                 int sockfd,
                 const InetAddress &localAddr,
-                const InetAddress &peerAddr);
+                const InetAddress &peerAddr,
+                uint64_t id = 0);
 
   ~TcpConnection();
 
-  EventLoop *getLoop() const { return loop_; }
+  // 连接迁移后会变成新的loop，任意线程可读
+  EventLoop *getLoop() const { return loop_.load(std::memory_order_acquire); }
   const std::string &name() const { return name_; }
+  // TcpServer分配的连接编号，在本server内唯一，用于ConnectionRegistry::find
+  uint64_t id() const { return id_; }
   const InetAddress &localAddress() const { return localAddr_; }
   const InetAddress &peerAddress() const { return peerAddr_; }
 
@@ -38,9 +51,93 @@ public:
 
   // 发送数据
   void send(const std::string &buf);
+  // 发送共享数据块，发不完时发送队列里只保存引用，不拷贝；用于把同一条消息广播给大量连接
+  void send(const Payload &payload);
   // 关闭连接
   void shutdown();
 
+  // 开启发送环，在把连接交给其他线程之前(比如ConnectionCallback里)调用，capacity向上取整到2的幂
+  // 之后其他线程的send(string)直接把数据拷进环里，不分配任务也不抢loop的锁；每个连接只在从空闲变为有数据时
+  // 挂到所属loop的待发送列表上一次，loop每轮一次取走整个列表，一批消息只唤醒一次loop
+  // 环满或发送Payload时退回到投递任务，顺序不变
+  void enableSendRing(size_t capacity);
+  // 由所属loop取走待发送列表时调用：把环里的数据移进发送路径
+  void handleSendRing();
+  // 待发送列表的链接指针，只由EventLoop使用
+  TcpConnection *nextSendRing() const { return nextSendRing_; }
+  void setNextSendRing(TcpConnection *next) { nextSendRing_ = next; }
+
+  // 在连接当前所属的loop线程中执行cb，迁移过程中先暂存，迁移完成后在新loop上按顺序执行
+  void queueInLoop(std::function<void()> cb);
+
+  // 把连接迁移到target上：从原loop的poller摘下channel，缓冲区和状态原样保留，再注册到target的poller
+  // 迁移期间其他线程的send按调用顺序在target上执行；已经在迁移中或target就是当前loop时返回false
+  bool migrateTo(EventLoop *target);
+  bool migrating() const { return migrating_; }
+
+  // 在所属loop线程中调用：收发缓冲区都为空时把连接从poller摘下，返回dup出来的fd用于交给其他进程，
+  // 连接本身变为断开状态(会回调connectionCallback)，本进程关闭自己的fd时不会发FIN；不空闲时返回-1
+  int detachIfIdle();
+
+  // 累计读到的字节数，可在任意线程读取
+  uint64_t bytesReceived() const { return bytesRead_.load(std::memory_order_relaxed); }
+  // 流量计数，由所属loop线程更新，可在任意线程读取
+  ConnectionStats stats() const;
+
+  // 连接建立之前调用，之后recordLatency才会记录
+  void enableLatencyHistogram();
+  // 在所属loop线程中调用：记录从receiveTime(通常是MessageCallback收到的时间)到现在的耗时
+  void recordLatency(Timestamp receiveTime)
+  {
+    if (latency_)
+    {
+      int64_t micros = Timestamp::now().microSecondsSinceEpoch() - receiveTime.microSecondsSinceEpoch();
+      latency_->record(micros > 0 ? static_cast<uint64_t>(micros) * 1000 : 0);
+    }
+  }
+  // 请求耗时分布(纳秒)，没开启时为空，可在任意线程调用
+  Histogram::Snapshot latencySnapshot() const;
+
+  // 公平预算，连接建立之前或在所属loop线程中调用，0表示不限(默认)
+  // 每轮事件循环最多从socket读bytesPerIteration字节，读不完的LT模式下下一轮poll会再报上来，
+  // 各活跃连接轮流读，大流量连接不会让同一轮里的小请求排在它的几MB数据后面；按连接设置不同的预算即为加权轮转。
+  // 开启后MessageCallback可以只处理一部分数据(比如最多N条消息)就返回，只要本次有消费，
+  // 剩下的数据会在本轮其他channel处理完之后再交给MessageCallback
+  void setFairnessBudget(size_t bytesPerIteration) { fairnessBudget_ = bytesPerIteration; }
+
+  // 令牌桶限速，在所属loop线程中调用(比如ConnectionCallback里)，rate为字节/秒，<=0取消该方向的限速
+  // 读令牌用完时暂停读事件，写令牌用完时暂停handleWrite，由所属loop的TrafficShaper定时补充后恢复
+  void setReadRateLimit(double rate, double burst = 0);
+  void setWriteRateLimit(double rate, double burst = 0);
+  // 在所属loop线程中调用：和本loop上同名租户的连接共用TrafficShaper::setTenantLimits设置的桶
+  void setTenant(const std::string &name);
+
+  // 由TrafficShaper每次tick时调用：补充令牌，返回是否还需要继续tick；恢复暂停的读写
+  bool refillShaping(double seconds);
+  void resumeShaping();
+
+  // 收发缓冲区占用的内存，记在所属loop的MemoryBudget上，只能在所属loop线程中调用
+  size_t bufferFootprint() const { return inputBuffer_.capacity() + outputBuffer_.capacity(); }
+  // 所属loop或进程的内存预算用尽时，缓冲区占用不低于本loop平均值的连接在下一次读或send时暂停读，
+  // 回调cb(conn, bufferFootprint())，closeOnPressure为true时随后关闭该连接；预算回落后由MemoryGovernor恢复读
+  // 连接建立之前或在所属loop线程中调用
+  void setMemoryPressureCallback(const MemoryPressureCallback &cb) { memoryPressureCallback_ = cb; }
+  void setCloseOnMemoryPressure(bool on) { closeOnMemoryPressure_ = on; }
+  // 由MemoryGovernor调用
+  void resumeFromMemoryPressure();
+
+  // 零拷贝发送(SO_ZEROCOPY)，连接建立之前或在所属loop线程中调用，threshold为0时关闭，socket不支持时返回false
+  // 不小于threshold字节的Payload用sendmsg(MSG_ZEROCOPY)发送，内核直接引用数据块的页，数据块一直保留到
+  // 内核在错误队列上通知发送完成(EPOLLERR，在handleError里读取)；更小的数据和send(string)照旧拷贝
+  // 每次零拷贝发送都要锁页并收一条完成通知，数据块小时反而比拷贝慢，threshold一般取几十KB
+  bool enableZeroCopy(size_t threshold);
+
+  // 连接建立之前调用：用recvmsg读取并带回内核的软件接收时间戳，同时在所属loop上统计排队时间
+  void enableReceiveTimestamps();
+  // 在MessageCallback里调用：内核收到本次读出的最新数据的时间，没开启或内核没给时无效
+  // 和receiveTime(poll返回的时间)之差是数据在socket里排队的时间
+  Timestamp kernelReceiveTime() const { return kernelReceiveTime_; }
+
   void setConnectionCallback(const ConnectionCallback &cb) { connectionCallback_ = cb; }
   void setMessageCallback(const MessageCallback &cb) { messageCallback_ = cb; }
   void setWriteCompleteCallback(const WriteCompleteCallback &cb) { writeCompleteCallback_ = cb; }
@@ -64,15 +161,48 @@ private:
   void setState(StateE state) { state_ = state; }
 
   void handleRead(Timestamp recevieTime);
+  void deliverMessage(Timestamp receiveTime);
+  void resumeMessage(Timestamp receiveTime);
   void handleWrite();
   void handleClose();
   void handleError();
 
-  void sendInLoop(const void *data, size_t len);
+  // payload不为空时data就是payload->data()，没发完的部分按引用排队
+  void sendInLoop(const void *data, size_t len, const Payload *payload = nullptr);
+  // 跨线程投递的发送任务：先发完发送环里更早写入的数据
+  void sendQueued(const void *data, size_t len, const Payload *payload);
+  // 在所属loop线程中调用：发送环里已提交的数据按顺序交给sendInLoop
+  void drainSendRing();
+  // 发送队列里有共享数据块时用writev一起发，maxBytes>0时最多发maxBytes字节
+  ssize_t writeOutputChain(int *savedErrno, size_t maxBytes);
+  bool zeroCopyEligible(const Payload &payload) const { return zeroCopyThreshold_ > 0 && payload.size() >= zeroCopyThreshold_; }
+  // 用MSG_ZEROCOPY发送payload的前len字节，发出去的部分保留到完成通知到达，出错时返回-1并保留errno
+  ssize_t writeZeroCopy(const Payload &payload, size_t len);
+  // 读错误队列里的零拷贝完成通知，释放对应的数据块
+  void reapZeroCopy();
+  void retrieveOutputChain(size_t len);
+  // 还没发出去的字节数，包括outputBuffer_和排队的共享数据块
+  size_t outputBytes() const { return outputBuffer_.readableBytes() + payloadBytes_; }
   void shutdownInLoop();
+  // 预算用尽且本连接是大户时暂停读，返回是否暂停了
+  bool checkMemoryPressure();
+  // 预算紧张时把空了的缓冲区缩回初始大小
+  void releaseIdleBuffer(Buffer *buffer);
+  void forceCloseInLoop();
+
+  void migrateInLoop(EventLoop *target);
+  void registerShaping();
+  // 本次最多能读/写多少字节，不限速时为0
+  size_t readAllowance() const;
+  size_t writeAllowance() const;
+  void consumeWriteTokens(size_t n);
+  bool readShaped() const { return readBucket_ || (tenant_ && tenant_->read); }
+  bool writeShaped() const { return writeBucket_ || (tenant_ && tenant_->write); }
+  void attachInLoop(bool reading, bool writing);
 
-  EventLoop *loop_; // 这里绝对不是baseloop，因为TcpConnection都是在subloop里面管理的
+  std::atomic<EventLoop *> loop_; // 这里绝对不是baseloop，因为TcpConnection都是在subloop里面管理的
   const std::string name_;
+  const uint64_t id_;
   std::atomic_int state_;
   bool reading_;
 
@@ -86,9 +216,72 @@ private:
   MessageCallback messageCallback_;             // 有读写消息时的回调
   WriteCompleteCallback writeCompleteCallback_; // 消息发送完成以后的回调
   HighWaterMarkCallback highWaterMarkCallback_;
+  MemoryPressureCallback memoryPressureCallback_;
   CloseCallback closeCallback_;
   size_t highWaterMark_;
 
   Buffer inputBuffer_;  // 接收数据的缓冲区
   Buffer outputBuffer_; // 发送数据的缓冲区
+
+  // 有共享数据块排队时的发送顺序，为空时所有待发送数据都在outputBuffer_里
+  // payload为空的一段表示outputBuffer_里接下来的bufferBytes字节
+  struct OutputSegment
+  {
+    Payload payload;
+    size_t bufferBytes;
+  };
+  std::deque<OutputSegment> outputChain_;
+  size_t payloadBytes_; // outputChain_里共享数据块的字节数
+
+  // 零拷贝发送，只在所属loop线程中访问
+  size_t zeroCopyThreshold_; // 0表示没开启
+  struct ZeroCopyPin
+  {
+    uint32_t id; // 内核给每次零拷贝sendmsg的编号，从0开始递增
+    Payload payload;
+  };
+  std::deque<ZeroCopyPin> zeroCopyPins_; // 已交给内核、还没收到完成通知的数据块
+  uint32_t nextZeroCopyId_;
+
+  std::mutex mutex_;                           // 保护loop_切换和下面的backlog_
+  std::atomic_bool migrating_;                 // 从migrateTo到新loop接管之间为true
+  std::vector<std::function<void()>> backlog_; // 迁移期间投递给本连接的任务
+
+  // 流量计数，只有所属loop线程写
+  std::atomic<uint64_t> bytesRead_;
+  std::atomic<uint64_t> bytesWritten_;
+  std::atomic<uint64_t> readCalls_;
+  std::atomic<uint64_t> writeCalls_;
+  std::atomic<uint64_t> highWaterEvents_;
+  std::atomic<uint64_t> outputBufferedNs_;
+  std::atomic<int64_t> bufferedSinceNs_; // outputBuffer从空变为非空的时刻，为空时是0
+  std::atomic<uint64_t> zeroCopySends_;
+  std::atomic<uint64_t> zeroCopyBytes_;
+  std::atomic<uint64_t> zeroCopyCopied_;
+  std::unique_ptr<Histogram> latency_;
+
+  bool receiveTimestamps_;
+  Timestamp kernelReceiveTime_;
+
+  size_t fairnessBudget_;
+  bool resumeQueued_; // 已经排队等着再次交给MessageCallback
+
+  // 限速，只在所属loop线程中访问
+  std::unique_ptr<TokenBucket> readBucket_;
+  std::unique_ptr<TokenBucket> writeBucket_;
+  std::string tenantName_;
+  TrafficShaper::TenantPtr tenant_;
+  bool shapingRegistered_; // 已在所属loop的TrafficShaper里登记
+  bool readThrottled_;     // 读令牌用完，暂停了读事件
+  bool writeThrottled_;    // 写令牌用完，暂停了写事件
+
+  bool closeOnMemoryPressure_;
+  bool memoryPaused_; // 内存预算用尽，暂停了读事件
+
+  // 发送环，生产者线程写，所属loop线程读
+  std::unique_ptr<SendRing> sendRing_;
+  std::atomic_bool sendRingDirty_;     // 已挂在loop的待发送列表上
+  std::atomic_int sendRingBypass_;     // 已投递、还没执行的跨线程发送任务数，不为0时新数据也走任务，保证顺序
+  TcpConnectionPtr sendRingHold_;      // 挂在列表上期间保持连接存活
+  TcpConnection *nextSendRing_;
 };
\ No newline at end of file
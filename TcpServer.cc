@@ -1,7 +1,12 @@
 #include "TcpServer.h"
 #include "Logger.h"
+#include "Handoff.h"
 
+#include <algorithm>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
 
 // 判断构造函数传入的loop是否为空
 EventLoop *CheckLoopNotNull(EventLoop *loop)
@@ -13,16 +18,62 @@ EventLoop *CheckLoopNotNull(EventLoop *loop)
   return loop;
 }
 
+// 继承来的监听socket绑定的地址
+static std::string localIpPort(int sockfd)
+{
+  sockaddr_in local;
+  memset(&local, 0, sizeof local);
+  socklen_t addrlen = sizeof local;
+  if (::getsockname(sockfd, (sockaddr *)&local, &addrlen) < 0)
+  {
+    LOG_ERROR("sockets::getLocalAddr");
+  }
+  return InetAddress(local).toIpPort();
+}
+
 TcpServer::TcpServer(EventLoop *loop, const InetAddress &listenAddr, const std::string &nameArg, Option option)
-    : loop_(CheckLoopNotNull(loop)),
-      ipPort_(listenAddr.toIpPort()),
+    : TcpServer(loop, new Acceptor(CheckLoopNotNull(loop), listenAddr, option == kReusePort), listenAddr.toIpPort(), nameArg)
+{
+}
+
+TcpServer::TcpServer(EventLoop *loop, int listenFd, const std::string &nameArg)
+    : TcpServer(loop, new Acceptor(CheckLoopNotNull(loop), listenFd), localIpPort(listenFd), nameArg)
+{
+}
+
+TcpServer::TcpServer(EventLoop *loop, Acceptor *acceptor, const std::string &ipPort, const std::string &nameArg)
+    : loop_(loop),
+      ipPort_(ipPort),
       name_(nameArg),
-      acceptor_(new Acceptor(loop, listenAddr, option == kReusePort)),
+      acceptor_(acceptor),
       threadPool_(new EventLoopThreadPool(loop, name_)),
       connectionCallback_(),
       messageCallback_(),
       nextConnId_(1),
-      started_(0)
+      started_(0),
+      latencyHistograms_(false),
+      receiveTimestamps_(false),
+      fairnessBudget_(0),
+      zeroCopyThreshold_(0),
+      admissionControl_(false),
+      rejecting_(false),
+      rejected_(0),
+      loopMemoryBudget_(0),
+      closeOnMemoryPressure_(false),
+      cpuSteering_(false),
+      steeredLocal_(0),
+      steeredNearby_(0),
+      steeredFallback_(0),
+      rebalanceHotThreshold_(0.8),
+      rebalanceMinGap_(0.25),
+      rebalanceTimerId_(-1),
+      handoffListenFd_(-1),
+      handoffFd_(-1),
+      passIdleConnections_(false),
+      drainTimeout_(0),
+      drainTimerId_(-1),
+      pendingHandoffs_(0),
+      draining_(false)
 {
   // 当有新用户连接时，会执行TcpServer：：newConnction（）回调
   acceptor_->setNewConnectionCallback(std::bind(&TcpServer::newConnection,
@@ -31,14 +82,21 @@ TcpServer::TcpServer(EventLoop *loop, const InetAddress &listenAddr, const std::
 
 TcpServer::~TcpServer()
 {
+  if (drainTimerId_ >= 0)
+  {
+    loop_->cancel(drainTimerId_); // 定时器回调里用了this
+  }
+  if (rebalanceTimerId_ >= 0)
+  {
+    loop_->cancel(rebalanceTimerId_);
+  }
   for (auto &item : connections_)
   {
     TcpConnectionPtr conn(item.second); // 这个局部的shared_ptr出右括号可以自动释放new出来的TcpConnection对象资源
     item.second.reset();
 
     // 销毁连接
-    conn->getLoop()->runInLoop(
-        std::bind(&TcpConnection::connectDestroyed, conn));
+    conn->queueInLoop(std::bind(&TcpConnection::connectDestroyed, conn));
   }
 }
 
@@ -53,7 +111,8 @@ void TcpServer::start()
 {
   if (started_++ == 0) // 防止一个TcpServer对象被启动多次
   {
-    threadPool_->start(threadInitCallback_); // 启动底层的loop线程池
+    threadPool_->start(threadInitCallback_, threadExitCallback_); // 启动底层的loop线程池
+    applyLoopLimits();
     loop_->runInLoop(std::bind(&Acceptor::listen, acceptor_.get()));
   }
 }
@@ -61,11 +120,27 @@ void TcpServer::start()
 // 有一个新的客户端的连接，acceptor会执行这个回调操作
 void TcpServer::newConnection(int sockfd, const InetAddress &peerAddr)
 {
-  // 轮询选择一个subLoop来管理channel
-  EventLoop *ioLoop = threadPool_->getNextLoop();
+  // 按cpu亲和或选择策略挑一个subLoop来管理channel，过载时拒绝
+  EventLoop *ioLoop = admissionControl_ ? admit(sockfd, peerAddr) : selectLoop(sockfd, peerAddr);
+  if (ioLoop == nullptr)
+  {
+    rejectConnection(sockfd, peerAddr);
+    return;
+  }
+  if (rejecting_)
+  {
+    rejecting_ = false;
+    LOG_INFO("TcpServer::newConnection [%s] - admitting again after %llu rejected \n",
+             name_.c_str(), static_cast<unsigned long long>(numRejected()));
+  }
+  establishConnection(sockfd, peerAddr, ioLoop);
+}
+
+void TcpServer::establishConnection(int sockfd, const InetAddress &peerAddr, EventLoop *ioLoop)
+{
   char buf[64] = {0};
-  snprintf(buf, sizeof buf, "-%s#%d", ipPort_.c_str(), nextConnId_);
-  ++nextConnId_;
+  const uint64_t connId = nextConnId_++;
+  snprintf(buf, sizeof buf, "-%s#%llu", ipPort_.c_str(), static_cast<unsigned long long>(connId));
   std::string connName = name_ + buf;
 
   LOG_INFO("TcpConnection::newConnection [%s] - new connection [%s] from %s \n",
@@ -87,9 +162,29 @@ void TcpServer::newConnection(int sockfd, const InetAddress &peerAddr)
       connName,
       sockfd, // socket,channel
       localAddr,
-      peerAddr));
+      peerAddr,
+      connId));
 
+  // 选定loop时就计入连接数，不等connectEstablised在subloop里执行，
+  // 否则同一批accept进来的连接看到的计数都一样，按连接数选loop的策略会全挑中同一个loop；connectDestroyed时减掉
+  ioLoop->adjustConnectionCount(1);
   connections_[connName] = conn;
+  registry_.add(conn);
+  if (latencyHistograms_)
+  {
+    conn->enableLatencyHistogram();
+  }
+  if (receiveTimestamps_)
+  {
+    conn->enableReceiveTimestamps();
+  }
+  conn->setFairnessBudget(fairnessBudget_);
+  if (zeroCopyThreshold_ > 0)
+  {
+    conn->enableZeroCopy(zeroCopyThreshold_);
+  }
+  conn->setMemoryPressureCallback(memoryPressureCallback_);
+  conn->setCloseOnMemoryPressure(closeOnMemoryPressure_);
   // 下面的回调都是用户设置给TcpServer=》TcpConnection=》channel=》注册到poller=》notify channel调用回调
   conn->setConnectionCallback(connectionCallback_);
   conn->setMessageCallback(messageCallback_);
@@ -103,6 +198,195 @@ void TcpServer::newConnection(int sockfd, const InetAddress &peerAddr)
   ioLoop->runInLoop(std::bind(&TcpConnection::connectEstablised, conn));
 }
 
+EventLoop *TcpServer::selectLoop(int sockfd, const InetAddress &peerAddr)
+{
+  if (cpuSteering_)
+  {
+    // 内核记录的最后一次处理该连接软中断的cpu
+    int cpu = -1;
+    socklen_t len = sizeof cpu;
+    if (::getsockopt(sockfd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len) < 0)
+    {
+      cpu = -1;
+    }
+    int distance = 0;
+    EventLoop *loop = threadPool_->getLoopForCpu(cpu, &distance);
+    if (loop != nullptr)
+    {
+      if (distance == 0)
+      {
+        steeredLocal_.fetch_add(1, std::memory_order_relaxed);
+      }
+      else
+      {
+        steeredNearby_.fetch_add(1, std::memory_order_relaxed);
+      }
+      return loop;
+    }
+    steeredFallback_.fetch_add(1, std::memory_order_relaxed);
+  }
+  return threadPool_->getNextLoop(peerAddr);
+}
+
+void TcpServer::setAdmissionLimits(const AdmissionLimits &limits, const std::string &rejectResponse)
+{
+  limits_ = limits;
+  rejectResponse_ = rejectResponse;
+  admissionControl_ = limits.maxConnections > 0 || limits.maxConnectionsPerLoop > 0 ||
+                      limits.maxPendingFunctors > 0 || limits.maxBufferedBytes > 0;
+  if (started_ > 0)
+  {
+    applyLoopLimits();
+  }
+}
+
+void TcpServer::setMemoryBudget(int64_t processBytes, int64_t loopBytes, bool closeOffenders)
+{
+  MemoryBudget::process()->setLimit(processBytes);
+  loopMemoryBudget_ = loopBytes;
+  closeOnMemoryPressure_ = closeOffenders;
+  if (started_ > 0)
+  {
+    applyLoopLimits();
+  }
+}
+
+// 把各loop上的限制设置好，loop数变化后重新均分待发送字节的上限
+void TcpServer::applyLoopLimits()
+{
+  std::vector<EventLoop *> loops = threadPool_->getAllLoops();
+  int64_t bytesPerLoop = limits_.maxBufferedBytes > 0 ? std::max<int64_t>(limits_.maxBufferedBytes / static_cast<int64_t>(loops.size()), 1) : 0;
+  for (EventLoop *loop : loops)
+  {
+    loop->setOverloadLimits(limits_.maxConnectionsPerLoop, limits_.maxPendingFunctors, bytesPerLoop);
+    loop->memoryBudget()->setLimit(loopMemoryBudget_);
+  }
+}
+
+bool TcpServer::overloaded() const
+{
+  std::vector<EventLoop *> loops = threadPool_->getAllLoops();
+  if (overServerLimits(loops))
+  {
+    return true;
+  }
+  for (EventLoop *loop : loops)
+  {
+    if (!loop->overloaded())
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+// 整个server的连接数和待发送字节数
+bool TcpServer::overServerLimits(const std::vector<EventLoop *> &loops) const
+{
+  if (limits_.maxConnections > 0 && connections_.size() >= limits_.maxConnections)
+  {
+    return true;
+  }
+  if (limits_.maxBufferedBytes > 0)
+  {
+    int64_t buffered = 0;
+    for (EventLoop *loop : loops)
+    {
+      buffered += loop->pendingBytes();
+    }
+    return buffered >= limits_.maxBufferedBytes;
+  }
+  return false;
+}
+
+// 返回接收新连接的loop，过载时返回nullptr
+EventLoop *TcpServer::admit(int sockfd, const InetAddress &peerAddr)
+{
+  std::vector<EventLoop *> loops = threadPool_->getAllLoops();
+  if (overServerLimits(loops))
+  {
+    return nullptr;
+  }
+  EventLoop *ioLoop = selectLoop(sockfd, peerAddr);
+  if (!ioLoop->overloaded())
+  {
+    return ioLoop;
+  }
+  // 选中的loop过载时改用没过载的loop里连接最少的
+  EventLoop *best = nullptr;
+  for (EventLoop *loop : loops)
+  {
+    if (!loop->overloaded() && (best == nullptr || loop->connectionCount() < best->connectionCount()))
+    {
+      best = loop;
+    }
+  }
+  return best;
+}
+
+void TcpServer::rejectConnection(int sockfd, const InetAddress &peerAddr)
+{
+  rejected_.fetch_add(1, std::memory_order_relaxed);
+  if (!rejecting_)
+  {
+    rejecting_ = true;
+    LOG_INFO("TcpServer::newConnection [%s] - overloaded, rejecting new connections (first from %s) \n",
+             name_.c_str(), peerAddr.toIpPort().c_str());
+  }
+  if (!rejectResponse_.empty())
+  {
+    // 非阻塞socket，发不完就算了，不能让过载的baseloop再等对端
+    ::send(sockfd, rejectResponse_.data(), rejectResponse_.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+    ::shutdown(sockfd, SHUT_WR);
+    // 接收缓冲区里还有数据时close会发RST，对端可能来不及读到上面的响应
+    char discard[4096];
+    while (::recv(sockfd, discard, sizeof discard, MSG_DONTWAIT) > 0)
+    {
+    }
+  }
+  ::close(sockfd);
+}
+
+TcpServer::SteeringStats TcpServer::steeringStats() const
+{
+  SteeringStats stats;
+  stats.local = steeredLocal_.load(std::memory_order_relaxed);
+  stats.nearby = steeredNearby_.load(std::memory_order_relaxed);
+  stats.fallback = steeredFallback_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+ConnectionStats TcpServer::connectionStats() const
+{
+  ConnectionStats total = closedStats_;
+  for (const auto &item : connections_)
+  {
+    total.merge(item.second->stats());
+  }
+  return total;
+}
+
+Histogram::Snapshot TcpServer::latencySnapshot() const
+{
+  Histogram::Snapshot total = closedLatency_;
+  if (latencyHistograms_)
+  {
+    for (const auto &item : connections_)
+    {
+      total.merge(item.second->latencySnapshot());
+    }
+  }
+  return total;
+}
+
+void TcpServer::forEachConnection(const std::function<void(const TcpConnectionPtr &)> &cb) const
+{
+  for (const auto &item : connections_)
+  {
+    cb(item.second);
+  }
+}
+
 void TcpServer::removeConnection(const TcpConnectionPtr &conn)
 {
   // mainLoop
@@ -115,11 +399,289 @@ void TcpServer::removeConnectionInLoop(const TcpConnectionPtr &conn)
   LOG_INFO("TcpServer::removeConnectionInLoop [%s] - connection %s \n",
            name_.c_str(), conn->name().c_str());
 
-  // 在mainloop的map中删除对应的连接
-  connections_.erase(conn->name());
+  // 在mainloop的map中删除对应的连接，计数并入已关闭连接的汇总
+  if (connections_.erase(conn->name()) > 0)
+  {
+    registry_.remove(conn);
+    closedStats_.merge(conn->stats());
+    if (latencyHistograms_)
+    {
+      closedLatency_.merge(conn->latencySnapshot());
+    }
+  }
+
+  // 再去对应的ioloop中执行对应的连接销毁函数，连接正在迁移时由它转交给新的loop
+  conn->queueInLoop(std::bind(&TcpConnection::connectDestroyed, conn));
+
+  checkDrained();
+}
+
+void TcpServer::addLoop()
+{
+  loop_->runInLoop(std::bind(&TcpServer::addLoopInLoop, this));
+}
+
+void TcpServer::removeLoop()
+{
+  loop_->runInLoop(std::bind(&TcpServer::removeLoopInLoop, this));
+}
+
+void TcpServer::addLoopInLoop()
+{
+  EventLoop *loop = threadPool_->addLoop();
+  applyLoopLimits();
+  LOG_INFO("TcpServer::addLoop [%s] - loop %p \n", name_.c_str(), loop);
+}
+
+void TcpServer::removeLoopInLoop()
+{
+  EventLoop *victim = threadPool_->removeLoop();
+  if (victim == nullptr)
+  {
+    return;
+  }
+  LOG_INFO("TcpServer::removeLoop [%s] - loop %p \n", name_.c_str(), victim);
+  applyLoopLimits();
+  retireLoopInLoop(victim);
+}
+
+// 把victim上的连接迁走，确认没有连接留在victim上之后再结束victim线程
+void TcpServer::retireLoopInLoop(EventLoop *victim)
+{
+  bool busy = false;
+  for (auto &item : connections_)
+  {
+    const TcpConnectionPtr &conn = item.second;
+    if (conn->migrating())
+    {
+      busy = true; // 可能正迁往victim，等它落地后再检查
+    }
+    else if (conn->getLoop() == victim)
+    {
+      conn->migrateTo(threadPool_->getNextLoop(conn->peerAddress()));
+      busy = true;
+    }
+  }
 
-  // 再去对应的ioloop中执行对应的连接销毁函数
-  EventLoop *ioLoop = conn->getLoop();
-  ioLoop->queueInLoop(
-      std::bind(&TcpConnection::connectDestroyed, conn));
+  if (!busy)
+  {
+    threadPool_->retireLoop(victim);
+    return;
+  }
+
+  // migrateInLoop都排在victim的任务队列里，绕victim一圈再回到baseloop检查
+  EventLoop *baseLoop = loop_;
+  victim->queueInLoop([this, baseLoop, victim]()
+                      { baseLoop->queueInLoop(std::bind(&TcpServer::retireLoopInLoop, this, victim)); });
+}
+
+void TcpServer::enableRebalance(double interval, double hotThreshold, double minGap)
+{
+  rebalanceHotThreshold_ = hotThreshold;
+  rebalanceMinGap_ = minGap;
+  // 重复调用时换掉旧的定时器，不叠加
+  if (rebalanceTimerId_ >= 0)
+  {
+    loop_->cancel(rebalanceTimerId_);
+  }
+  rebalanceTimerId_ = loop_->runEvery(interval, std::bind(&TcpServer::rebalance, this));
+}
+
+void TcpServer::rebalance()
+{
+  timespec ts;
+  ::clock_gettime(CLOCK_MONOTONIC, &ts);
+  int64_t wallMicros = static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+
+  // 计算上一轮到现在各subloop的cpu占用率
+  std::vector<EventLoop *> loops = threadPool_->getAllLoops();
+  EventLoop *hot = nullptr;
+  EventLoop *cold = nullptr;
+  double hotUsage = 0.0;
+  double coldUsage = 0.0;
+  std::unordered_map<EventLoop *, LoopSample> samples;
+  for (EventLoop *loop : loops)
+  {
+    LoopSample now = {loop->cpuTimeMicros(), wallMicros};
+    samples[loop] = now;
+    auto it = loopSamples_.find(loop);
+    if (it == loopSamples_.end() || now.wallMicros <= it->second.wallMicros)
+    {
+      continue; // 新加入的loop下一轮再参与
+    }
+    double usage = static_cast<double>(now.cpuMicros - it->second.cpuMicros) / (now.wallMicros - it->second.wallMicros);
+    if (hot == nullptr || usage > hotUsage)
+    {
+      hot = loop;
+      hotUsage = usage;
+    }
+    if (cold == nullptr || usage < coldUsage)
+    {
+      cold = loop;
+      coldUsage = usage;
+    }
+  }
+  loopSamples_.swap(samples);
+
+  // 找出最忙loop上这段时间收数据最多的连接
+  std::unordered_map<TcpConnection *, uint64_t> connSamples;
+  TcpConnectionPtr heaviest;
+  uint64_t heaviestDelta = 0;
+  int hotConns = 0;
+  for (auto &item : connections_)
+  {
+    const TcpConnectionPtr &conn = item.second;
+    uint64_t bytes = conn->bytesReceived();
+    connSamples[conn.get()] = bytes;
+    if (conn->getLoop() != hot || conn->migrating())
+    {
+      continue;
+    }
+    ++hotConns;
+    auto it = connSamples_.find(conn.get());
+    uint64_t delta = (it == connSamples_.end() || bytes < it->second) ? 0 : bytes - it->second;
+    if (delta > heaviestDelta)
+    {
+      heaviest = conn;
+      heaviestDelta = delta;
+    }
+  }
+  connSamples_.swap(connSamples);
+
+  // 只有一个连接的loop迁走它只是把热点搬了个地方
+  if (hot == nullptr || hot == cold || hotUsage < rebalanceHotThreshold_ ||
+      hotUsage - coldUsage < rebalanceMinGap_ || hotConns < 2 || !heaviest)
+  {
+    return;
+  }
+  LOG_INFO("TcpServer::rebalance [%s] - move %s from loop %p(%.2f) to loop %p(%.2f) \n",
+           name_.c_str(), heaviest->name().c_str(), hot, hotUsage, cold, coldUsage);
+  heaviest->migrateTo(cold);
+}
+
+void TcpServer::adoptConnection(int sockfd, const InetAddress &peerAddr)
+{
+  // 接管的是已经在服务的连接，不做准入检查
+  loop_->runInLoop([this, sockfd, peerAddr]()
+                   { establishConnection(sockfd, peerAddr, selectLoop(sockfd, peerAddr)); });
+}
+
+void TcpServer::enableHandoff(const std::string &path, bool passIdleConnections, double drainTimeout)
+{
+  handoffPath_ = path;
+  passIdleConnections_ = passIdleConnections;
+  drainTimeout_ = drainTimeout;
+  loop_->runInLoop([this]()
+                   {
+    handoffListenFd_ = Handoff::listenOn(handoffPath_);
+    if (handoffListenFd_ < 0)
+    {
+      return;
+    }
+    handoffChannel_.reset(new Channel(loop_, handoffListenFd_));
+    handoffChannel_->setReadCallback(std::bind(&TcpServer::handleHandoffRequest, this));
+    handoffChannel_->enableReading(); });
+}
+
+// 新进程连上来了，交出监听socket，随后交出空闲连接
+void TcpServer::handleHandoffRequest()
+{
+  int fd = ::accept4(handoffListenFd_, nullptr, nullptr, SOCK_CLOEXEC); // 阻塞模式，发送几条消息即可
+  if (fd < 0)
+  {
+    return;
+  }
+  if (handoffFd_ >= 0 || draining_)
+  {
+    ::close(fd); // 只交接一次
+    return;
+  }
+  handoffFd_ = fd;
+  LOG_INFO("TcpServer::handoff [%s] - handing listen socket %s to new process \n", name_.c_str(), ipPort_.c_str());
+
+  // 监听socket不关闭，已在accept队列里的连接由新进程接收，因此不会有连接被拒绝
+  acceptor_->stopAccepting();
+  Handoff::sendFd(handoffFd_, 'L', ipPort_, acceptor_->fd());
+
+  if (passIdleConnections_)
+  {
+    EventLoop *baseLoop = loop_;
+    for (auto &item : connections_)
+    {
+      TcpConnectionPtr conn(item.second);
+      ++pendingHandoffs_;
+      conn->queueInLoop([this, baseLoop, conn]()
+                        {
+        int connfd = conn->detachIfIdle();
+        baseLoop->queueInLoop(std::bind(&TcpServer::handOffConnection, this, conn, connfd)); });
+    }
+  }
+  if (pendingHandoffs_ == 0)
+  {
+    finishHandoff();
+  }
+}
+
+void TcpServer::handOffConnection(const TcpConnectionPtr &conn, int connfd)
+{
+  if (connfd >= 0)
+  {
+    Handoff::sendFd(handoffFd_, 'C', conn->peerAddress().toIpPort(), connfd);
+    ::close(connfd);
+    removeConnectionInLoop(conn); // 本进程关闭自己的fd，连接在新进程中继续
+  }
+  if (--pendingHandoffs_ == 0)
+  {
+    finishHandoff();
+  }
+}
+
+void TcpServer::finishHandoff()
+{
+  Handoff::sendFd(handoffFd_, 'E', std::string(), -1);
+  ::close(handoffFd_);
+  // 可能正处在handoffChannel_自己的回调里，推迟到回调返回后再销毁
+  handoffChannel_->disableAll();
+  loop_->queueInLoop([this]()
+                     {
+    handoffChannel_->remove();
+    handoffChannel_.reset();
+    ::close(handoffListenFd_);
+    handoffListenFd_ = -1; });
+
+  // 剩下的连接继续服务直到对端关闭，超时后半关闭它们
+  draining_ = true;
+  LOG_INFO("TcpServer::handoff [%s] - draining %lu connections \n", name_.c_str(), connections_.size());
+  if (drainTimeout_ > 0)
+  {
+    drainTimerId_ = loop_->runAfter(drainTimeout_, [this]()
+                                    {
+      drainTimerId_ = -1;
+      for (auto &item : connections_)
+      {
+        item.second->shutdown();
+      } });
+  }
+  checkDrained();
+}
+
+void TcpServer::checkDrained()
+{
+  if (draining_ && connections_.empty())
+  {
+    draining_ = false;
+    if (drainTimerId_ >= 0)
+    {
+      loop_->cancel(drainTimerId_);
+      drainTimerId_ = -1;
+    }
+    if (drainedCallback_)
+    {
+      drainedCallback_();
+    }
+    else
+    {
+      loop_->quit();
+    }
+  }
 }
\ No newline at end of file
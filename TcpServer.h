@@ -11,6 +11,7 @@
 #include "Callbacks.h"
 #include "TcpConnection.h"
 #include "Buffer.h"
+#include "ConnectionRegistry.h"
 
 #include <functional>
 #include <string>
@@ -22,6 +23,7 @@ class TcpServer : noncopyable
 {
 public:
   using ThreadInitCallback = std::function<void(EventLoop *)>;
+  using ThreadExitCallback = std::function<void(EventLoop *)>;
 
   enum Option
   {
@@ -33,26 +35,132 @@ public:
             const InetAddress &listenAddr,
             const std::string &nameArg,
             Option option = kNoReusePort);
+  // 使用已经bind/listen好的socket，例如Handoff::takeOver从旧进程继承来的
+  TcpServer(EventLoop *loop, int listenFd, const std::string &nameArg);
 
   ~TcpServer();
 
   const std::string &ipPort() const { return ipPort_; }
+  const std::string &name() const { return name_; }
+  EventLoop *getLoop() const { return loop_; }
+
+  // 只能在baseloop线程中调用
+  size_t numConnections() const { return connections_.size(); }
+  uint64_t numAccepted() const { return nextConnId_ - 1; }
 
   void setThreadInitcallback(const ThreadInitCallback &cb) { threadInitCallback_ = cb; }
+  // subloop退出、析构之前在该loop线程中回调，和ThreadInitCallback成对使用，运行时removeLoop的loop也会回调
+  void setThreadExitCallback(const ThreadExitCallback &cb) { threadExitCallback_ = cb; }
   void setConnectionCallback(const ConnectionCallback &cb) { connectionCallback_ = cb; }
   void setMessageCallback(const MessageCallback &cb) { messageCallback_ = cb; }
   void setWriteCompleteCallback(const WriteCompleteCallback &cb) { writeCompleteCallback_ = cb; }
 
   // 设置底层subloop的个数
   void setThreadNum(int numThreads);
+  // start之前可通过线程池设置绑核、NUMA等选项
+  std::shared_ptr<EventLoopThreadPool> threadPool() { return threadPool_; }
+  // 设置新连接分配subloop的策略
+  void setLoadBalanceStrategy(LoadBalancer::Strategy strategy) { threadPool_->setLoadBalancer(strategy); }
+
+  // 按SO_INCOMING_CPU把新连接交给绑定在同一cpu(或最近cpu)上的subloop，需配合线程池绑核使用
+  // 找不到合适的subloop时退回到负载均衡策略
+  void setCpuSteering(bool on) { cpuSteering_ = on; }
+
+  struct SteeringStats
+  {
+    uint64_t local;    // 落在处理软中断的同一cpu上
+    uint64_t nearby;   // 落在同一物理核或同一NUMA节点上
+    uint64_t fallback; // 走负载均衡策略
+  };
+  SteeringStats steeringStats() const;
+
+  // start之前调用：每个连接带一个请求耗时直方图，应用在回调里用conn->recordLatency(receiveTime)记录
+  void enableLatencyHistograms(bool on) { latencyHistograms_ = on; }
+  // start之前调用：每个连接开启内核接收时间戳，见TcpConnection::kernelReceiveTime，排队时间统计在LoopMetrics里
+  void enableReceiveTimestamps(bool on) { receiveTimestamps_ = on; }
+  // start之前调用：新连接的公平预算，见TcpConnection::setFairnessBudget，0表示不限
+  void setFairnessBudget(size_t bytesPerIteration) { fairnessBudget_ = bytesPerIteration; }
+  // start之前调用：新连接开启零拷贝发送，见TcpConnection::enableZeroCopy，0表示不开启
+  void setZeroCopyThreshold(size_t bytes) { zeroCopyThreshold_ = bytes; }
+
+  // 准入控制，上限为0表示不检查该项
+  struct AdmissionLimits
+  {
+    AdmissionLimits()
+        : maxConnections(0), maxConnectionsPerLoop(0), maxPendingFunctors(0), maxBufferedBytes(0)
+    {
+    }
+    size_t maxConnections;     // 整个server的连接数
+    int maxConnectionsPerLoop; // 每个loop的连接数
+    size_t maxPendingFunctors; // 每个loop队列里等待执行的functor个数
+    int64_t maxBufferedBytes;  // 所有loop outputBuffer待发送字节之和，按loop数均分后也作为各loop的上限
+  };
+  // 新连接到来时server或所有subloop都已过载就直接拒绝(不会挑选过载的loop)，已建立的连接不受影响
+  // 拒绝时先把rejectResponse(例如"HTTP/1.1 503 ...")写给对端再关闭，为空时直接关闭
+  // 各loop的过载状态可在任意线程用EventLoop::overloaded()查询，只能在baseloop线程中调用
+  void setAdmissionLimits(const AdmissionLimits &limits, const std::string &rejectResponse = std::string());
+  // 按准入上限判断整个server是否过载，只能在baseloop线程中调用
+  bool overloaded() const;
+  uint64_t numRejected() const { return rejected_.load(std::memory_order_relaxed); }
+
+  // 连接收发缓冲区的内存预算，0表示不限：processBytes是进程级的(所有server共用)，loopBytes是每个loop的
+  // 预算用尽时占用最多的连接暂停读并回调cb，closeOffenders为true时随后关闭它们，详见TcpConnection::setMemoryPressureCallback
+  // 记账一直都在做，用量见EventLoop::memoryBudget()和MemoryBudget::process()，只能在baseloop线程中调用
+  void setMemoryBudget(int64_t processBytes, int64_t loopBytes, bool closeOffenders = false);
+  void setMemoryPressureCallback(const MemoryPressureCallback &cb) { memoryPressureCallback_ = cb; }
+
+  // 以下只能在baseloop线程中调用
+  // 所有连接(含已关闭的)的流量计数之和
+  ConnectionStats connectionStats() const;
+  // 所有连接(含已关闭的)请求耗时的合并分布，纳秒
+  Histogram::Snapshot latencySnapshot() const;
+  // 遍历当前所有连接，例如按stats()找出流量最大或最慢的客户端
+  void forEachConnection(const std::function<void(const TcpConnectionPtr &)> &cb) const;
+
+  // 当前连接按TcpConnection::id()的索引，可在任意线程中查找连接或按loop批量广播
+  ConnectionRegistry &registry() { return registry_; }
+  const ConnectionRegistry &registry() const { return registry_; }
 
   // 开启服务器监听
   void start();
 
+  // 运行时增减subloop，可在任意线程调用
+  // 减少时最后一个subloop不再分配新连接，其上的连接迁移到其余loop后该线程退出
+  void addLoop();
+  void removeLoop();
+
+  // 接管一个已建立的连接(例如从旧进程继承来的)，start之后调用，可在任意线程调用
+  void adoptConnection(int sockfd, const InetAddress &peerAddr);
+
+  // 不停机重启：在path上等待新进程来取监听socket(passIdleConnections为true时连同空闲连接一起交出)，
+  // 交接后不再accept，剩余连接处理完后回调drainedCallback(默认退出baseloop)，drainTimeout秒后还没断开的连接会被shutdown
+  void enableHandoff(const std::string &path, bool passIdleConnections = false, double drainTimeout = 0);
+  void setDrainedCallback(const std::function<void()> &cb) { drainedCallback_ = cb; }
+
+  // 每隔interval秒检查各subloop的cpu占用率，最忙的loop超过hotThreshold且比最闲的loop高出minGap时，
+  // 把最忙loop上这段时间收数据最多的连接迁移到最闲的loop上，每轮每个loop最多迁走一个连接
+  void enableRebalance(double interval, double hotThreshold = 0.8, double minGap = 0.25);
+
 private:
+  TcpServer(EventLoop *loop, Acceptor *acceptor, const std::string &ipPort, const std::string &nameArg);
+
   void newConnection(int sockfd, const InetAddress &peerAddr);
+  void establishConnection(int sockfd, const InetAddress &peerAddr, EventLoop *ioLoop);
+  EventLoop *selectLoop(int sockfd, const InetAddress &peerAddr);
+  EventLoop *admit(int sockfd, const InetAddress &peerAddr);
+  void rejectConnection(int sockfd, const InetAddress &peerAddr);
+  void applyLoopLimits();
+  bool overServerLimits(const std::vector<EventLoop *> &loops) const;
   void removeConnection(const TcpConnectionPtr &conn);
   void removeConnectionInLoop(const TcpConnectionPtr &conn);
+  void addLoopInLoop();
+  void removeLoopInLoop();
+  void retireLoopInLoop(EventLoop *victim);
+  void rebalance();
+  void handleHandoffRequest();
+  void handOffConnection(const TcpConnectionPtr &conn, int connfd);
+  void finishHandoff();
+  void checkDrained();
 
   using ConnectionMap = std::unordered_map<std::string, TcpConnectionPtr>;
 
@@ -69,8 +177,57 @@ private:
   WriteCompleteCallback writeCompleteCallback_; // 消息发送完成以后的回调
 
   ThreadInitCallback threadInitCallback_; // loop线程初始化的回调
+  ThreadExitCallback threadExitCallback_; // loop线程退出的回调
   std::atomic_int started_;
 
   size_t nextConnId_;
   ConnectionMap connections_;
+  ConnectionRegistry registry_; // 和connections_同步增删
+
+  bool latencyHistograms_;
+  bool receiveTimestamps_;
+  size_t fairnessBudget_;
+  size_t zeroCopyThreshold_;
+  ConnectionStats closedStats_;         // 已关闭连接的计数之和，只在baseloop线程中访问
+  Histogram::Snapshot closedLatency_;
+
+  // 准入控制，只在baseloop线程中访问
+  bool admissionControl_;
+  AdmissionLimits limits_;
+  std::string rejectResponse_;
+  bool rejecting_; // 上一个新连接被拒绝了，用于只在进出过载时打日志
+  std::atomic<uint64_t> rejected_;
+
+  int64_t loopMemoryBudget_;
+  bool closeOnMemoryPressure_;
+  MemoryPressureCallback memoryPressureCallback_;
+
+  bool cpuSteering_;
+  std::atomic<uint64_t> steeredLocal_;
+  std::atomic<uint64_t> steeredNearby_;
+  std::atomic<uint64_t> steeredFallback_;
+
+  // 负载再均衡，只在baseloop线程中访问
+  struct LoopSample
+  {
+    int64_t cpuMicros;
+    int64_t wallMicros;
+  };
+  double rebalanceHotThreshold_;
+  double rebalanceMinGap_;
+  int64_t rebalanceTimerId_; // 没有开启时为-1
+  std::unordered_map<EventLoop *, LoopSample> loopSamples_;
+  std::unordered_map<TcpConnection *, uint64_t> connSamples_; // 上一轮采样时各连接的bytesReceived
+
+  // 不停机重启，只在baseloop线程中访问
+  std::string handoffPath_;
+  int handoffListenFd_;                     // 等待新进程连接的unix域socket
+  std::unique_ptr<Channel> handoffChannel_;
+  int handoffFd_;                           // 和新进程之间的连接
+  bool passIdleConnections_;
+  double drainTimeout_;
+  int64_t drainTimerId_;                    // 超时shutdown剩余连接的定时器，没有时为-1
+  int pendingHandoffs_;                     // 还没确认是否空闲的连接数
+  bool draining_;
+  std::function<void()> drainedCallback_;
 };
\ No newline at end of file
@@ -1,7 +1,9 @@
 #include "Thread.h"
 #include "CurrentThread.h"
+#include "CpuTopology.h"
 
 #include <semaphore.h>
+#include <pthread.h>
 
 std::atomic_int32_t Thread::numCreated_(0);
 
@@ -34,6 +36,12 @@ void Thread::start() // 一个Thread对象记录的就是一个新线程的详
                                                          {
       //获取tid
       tid_=CurrentThread::tid();
+      // 内核线程名最长15个字符，便于top/perf里区分各个loop线程
+      ::pthread_setname_np(::pthread_self(), name_.substr(0, 15).c_str());
+      if (!cpus_.empty())
+      {
+        CpuTopology::bindCurrentThread(cpus_);
+      }
       sem_post(&sem);
       // 开启一个新线程,专门执行线程函数
       func_(); }));
@@ -8,6 +8,7 @@
 #include <unistd.h>
 #include <string>
 #include <atomic>
+#include <vector>
 
 class Thread : noncopyable
 {
@@ -22,7 +23,10 @@ public:
 
   bool started() const { return started_; }
   pid_t tid() const { return tid_; }
-  const std::string &name() { return name_; }
+  const std::string &name() const { return name_; }
+
+  // start之前设置，新线程启动后先绑定到这些cpu上
+  void setCpuAffinity(const std::vector<int> &cpus) { cpus_ = cpus; }
 
   static int numCreated() { return numCreated_; }
 
@@ -35,5 +39,6 @@ private:
   pid_t tid_;
   ThreadFunc func_;
   std::string name_;
+  std::vector<int> cpus_;
   static std::atomic_int32_t numCreated_;
 };
\ No newline at end of file
@@ -1,29 +1,136 @@
 #include "Timestamp.h"
 
+#include <atomic>
+#include <string.h>
+#include <stdio.h>
 #include <time.h>
+#include <unistd.h>
+
+namespace
+{
+  // tsc到墙上时间的换算参数，重新校准时整块替换
+  struct TscParams
+  {
+    int64_t baseMicros;
+    uint64_t baseTicks;
+    double microsPerTick;
+  };
+
+  std::atomic<const TscParams *> g_tsc(nullptr);
+
+  // 同一秒内的toString直接复用，日志每行都要格式化时间
+  // 按6个int都取最长(各11个字符)加5个分隔符算，编译器按int取值范围检查截断
+  __thread time_t t_lastSecond = -1;
+  __thread char t_timeString[6 * 11 + 5 + 1];
+
+  int64_t realtimeMicros()
+  {
+    timespec ts;
+    ::clock_gettime(CLOCK_REALTIME, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * Timestamp::kMicroSecondsPerSecond + ts.tv_nsec / 1000;
+  }
+
+#if defined(__x86_64__) || defined(__i386__)
+  inline uint64_t readTsc() { return __builtin_ia32_rdtsc(); }
+
+  // 只有频率恒定且深度睡眠时不停的tsc才能拿来计时
+  bool tscUsable()
+  {
+    FILE *fp = ::fopen("/proc/cpuinfo", "re");
+    if (fp == nullptr)
+    {
+      return false;
+    }
+    bool constant = false, nonstop = false;
+    char line[4096];
+    while (::fgets(line, sizeof line, fp) != nullptr)
+    {
+      if (::strncmp(line, "flags", 5) == 0)
+      {
+        constant = ::strstr(line, " constant_tsc") != nullptr;
+        nonstop = ::strstr(line, " nonstop_tsc") != nullptr;
+        break;
+      }
+    }
+    ::fclose(fp);
+    return constant && nonstop;
+  }
+#endif
+}
 
 Timestamp::Timestamp() : microSecondsSinceEpoch_(0) {}
 Timestamp::Timestamp(int64_t microSecondsSinceEpoch) : microSecondsSinceEpoch_(microSecondsSinceEpoch) {}
+
 Timestamp Timestamp::now()
 {
-  return Timestamp(time(NULL));
+#if defined(__x86_64__) || defined(__i386__)
+  const TscParams *tsc = g_tsc.load(std::memory_order_acquire);
+  if (tsc != nullptr)
+  {
+    int64_t ticks = static_cast<int64_t>(readTsc() - tsc->baseTicks);
+    return Timestamp(tsc->baseMicros + static_cast<int64_t>(ticks * tsc->microsPerTick));
+  }
+#endif
+  return Timestamp(realtimeMicros());
 }
+
+bool Timestamp::enableTscClock(int calibrateMs)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  if (!tscUsable())
+  {
+    return false;
+  }
+  int64_t micros0 = realtimeMicros();
+  uint64_t ticks0 = readTsc();
+  ::usleep(static_cast<useconds_t>(calibrateMs > 0 ? calibrateMs : 20) * 1000);
+  int64_t micros1 = realtimeMicros();
+  uint64_t ticks1 = readTsc();
+  if (ticks1 <= ticks0 || micros1 <= micros0)
+  {
+    return false;
+  }
+
+  TscParams *params = new TscParams;
+  params->baseMicros = micros1;
+  params->baseTicks = ticks1;
+  params->microsPerTick = static_cast<double>(micros1 - micros0) / static_cast<double>(ticks1 - ticks0);
+  // 旧参数可能还有线程在读，不释放；只在重新校准时泄漏几十字节
+  g_tsc.store(params, std::memory_order_release);
+  return true;
+#else
+  (void)calibrateMs;
+  return false;
+#endif
+}
+
+void Timestamp::disableTscClock()
+{
+  g_tsc.store(nullptr, std::memory_order_release);
+}
+
 std::string Timestamp::toString() const
 {
-  tm *tm_time = localtime(&microSecondsSinceEpoch_);
-  char buf[128] = {0};
-  snprintf(buf, 128, "%4d/%02d/%02d %02d:%02d:%02d",
-           tm_time->tm_year + 1900,
-           tm_time->tm_mon + 1,
-           tm_time->tm_mday,
-           tm_time->tm_hour,
-           tm_time->tm_min,
-           tm_time->tm_sec);
-  return buf;
-};
-
-// int main()
-// {
-//   std::cout << Timestamp::now().toString() << std::endl;
-//   return 0;
-// }
\ No newline at end of file
+  time_t seconds = secondsSinceEpoch();
+  if (seconds != t_lastSecond)
+  {
+    tm tm_time;
+    localtime_r(&seconds, &tm_time); // 多个loop线程同时写日志，不能用localtime的静态缓冲区
+    snprintf(t_timeString, sizeof t_timeString, "%4d/%02d/%02d %02d:%02d:%02d",
+             tm_time.tm_year + 1900,
+             tm_time.tm_mon + 1,
+             tm_time.tm_mday,
+             tm_time.tm_hour,
+             tm_time.tm_min,
+             tm_time.tm_sec);
+    t_lastSecond = seconds;
+  }
+  return t_timeString;
+}
+
+std::string Timestamp::toFormattedString() const
+{
+  char micros[16]; // 取模后在(-1000000, 1000000)之间，最长".-999999"
+  snprintf(micros, sizeof micros, ".%06d", static_cast<int>(microSecondsSinceEpoch_ % kMicroSecondsPerSecond));
+  return toString() + micros;
+}
@@ -1,15 +1,59 @@
 #pragma once
 
 #include <iostream>
+#include <string>
+#include <stdint.h>
+#include <time.h>
 
+// 微秒精度的时间点。EventLoop每轮poll返回时取一次(pollReturnTime)，同一轮里的回调共用这个值
 class Timestamp
 {
 public:
   Timestamp();
   explicit Timestamp(int64_t microSecondsSinceEpoch);
+  // 默认走clock_gettime(CLOCK_REALTIME)，在vDSO里完成不进内核；开启tsc后换成rdtsc加校准
   static Timestamp now();
+  // "2024/01/02 03:04:05"，同一秒内复用上次格式化好的结果
   std::string toString() const;
+  // "2024/01/02 03:04:05.123456"
+  std::string toFormattedString() const;
+
+  int64_t microSecondsSinceEpoch() const { return microSecondsSinceEpoch_; }
+  time_t secondsSinceEpoch() const { return static_cast<time_t>(microSecondsSinceEpoch_ / kMicroSecondsPerSecond); }
+  bool valid() const { return microSecondsSinceEpoch_ > 0; }
+
+  // 用校准过的tsc计时，只在有constant_tsc的x86上生效，开启时阻塞约calibrateMs毫秒做校准；
+  // 不跟随ntp调整，长时间运行的进程需要定期重新调用以消除漂移。返回是否开启
+  static bool enableTscClock(int calibrateMs = 20);
+  static void disableTscClock();
+
+  // CLOCK_MONOTONIC的纳秒数，统计耗时用
+  static int64_t monotonicNanos()
+  {
+    timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+  }
+
+  static const int64_t kMicroSecondsPerSecond = 1000 * 1000;
 
 private:
   int64_t microSecondsSinceEpoch_;
-};
\ No newline at end of file
+};
+
+inline bool operator<(Timestamp lhs, Timestamp rhs)
+{
+  return lhs.microSecondsSinceEpoch() < rhs.microSecondsSinceEpoch();
+}
+
+inline bool operator==(Timestamp lhs, Timestamp rhs)
+{
+  return lhs.microSecondsSinceEpoch() == rhs.microSecondsSinceEpoch();
+}
+
+// 两个时间点相差的秒数
+inline double timeDifference(Timestamp high, Timestamp low)
+{
+  int64_t diff = high.microSecondsSinceEpoch() - low.microSecondsSinceEpoch();
+  return static_cast<double>(diff) / Timestamp::kMicroSecondsPerSecond;
+}
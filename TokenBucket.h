@@ -0,0 +1,34 @@
+#pragma once
+
+#include <algorithm>
+#include <stddef.h>
+
+/**
+ * 令牌桶，单位是字节。只在所属loop线程中使用，不加锁。
+ * 令牌由TrafficShaper的每loop定时器统一补充，桶本身不取时间。
+ */
+class TokenBucket
+{
+public:
+  // burst<=0时取50ms的量，至少4KB
+  TokenBucket(double rate, double burst)
+      : rate_(rate),
+        burst_(burst > 0 ? burst : std::max(rate * 0.05, 4096.0)),
+        tokens_(burst_)
+  {
+  }
+
+  double rate() const { return rate_; }
+  bool full() const { return tokens_ >= burst_; }
+
+  // 当前最多能用多少字节
+  size_t available() const { return tokens_ >= 1 ? static_cast<size_t>(tokens_) : 0; }
+  void consume(size_t n) { tokens_ -= static_cast<double>(n); }
+
+  void refill(double seconds) { tokens_ = std::min(burst_, tokens_ + rate_ * seconds); }
+
+private:
+  double rate_;
+  double burst_;
+  double tokens_;
+};
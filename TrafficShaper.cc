@@ -0,0 +1,95 @@
+#include "TrafficShaper.h"
+#include "EventLoop.h"
+#include "TcpConnection.h"
+
+#include <algorithm>
+
+TrafficShaper::TrafficShaper(EventLoop *loop, double tickSeconds)
+    : loop_(loop),
+      tickSeconds_(tickSeconds),
+      timerId_(-1),
+      lastTickNs_(0),
+      resumeCursor_(0)
+{
+}
+
+void TrafficShaper::setTenantLimits(const std::string &name, double readRate, double writeRate, double burst)
+{
+  TenantPtr t = tenant(name);
+  t->read.reset(readRate > 0 ? new TokenBucket(readRate, burst) : nullptr);
+  t->write.reset(writeRate > 0 ? new TokenBucket(writeRate, burst) : nullptr);
+}
+
+TrafficShaper::TenantPtr TrafficShaper::tenant(const std::string &name)
+{
+  TenantPtr &t = tenants_[name];
+  if (!t)
+  {
+    t = std::make_shared<Tenant>(tickSeconds_);
+  }
+  return t;
+}
+
+void TrafficShaper::add(const TcpConnectionPtr &conn)
+{
+  connections_.push_back(conn);
+}
+
+void TrafficShaper::startTicking()
+{
+  lastTickNs_ = Timestamp::monotonicNanos();
+  timerId_ = loop_->runEvery(tickSeconds_, std::bind(&TrafficShaper::tick, this));
+}
+
+void TrafficShaper::tick()
+{
+  // 按实际经过的时间补充，定时器晚到不会少给令牌
+  const int64_t now = Timestamp::monotonicNanos();
+  const double seconds = (now - lastTickNs_) / 1e9;
+  lastTickNs_ = now;
+
+  bool busy = false;
+  for (auto &item : tenants_)
+  {
+    Tenant &t = *item.second;
+    if (t.read)
+    {
+      t.read->refill(seconds);
+      busy = busy || !t.read->full();
+    }
+    if (t.write)
+    {
+      t.write->refill(seconds);
+      busy = busy || !t.write->full();
+    }
+  }
+
+  // 先给所有连接补充令牌，再恢复暂停的连接，租户桶补满之前恢复的连接不会抢先用光
+  std::vector<TcpConnectionPtr> live;
+  live.reserve(connections_.size());
+  size_t kept = 0;
+  for (size_t i = 0; i < connections_.size(); ++i)
+  {
+    TcpConnectionPtr conn = connections_[i].lock();
+    if (conn && conn->getLoop() == loop_)
+    {
+      busy = conn->refillShaping(seconds) || busy;
+      live.push_back(conn);
+      connections_[kept++] = connections_[i];
+    }
+  }
+  connections_.resize(kept);
+
+  // 每轮换一个连接先恢复，避免总是同一个连接先拿到租户令牌
+  for (size_t i = 0; i < live.size(); ++i)
+  {
+    live[(resumeCursor_ + i) % live.size()]->resumeShaping();
+  }
+  ++resumeCursor_;
+
+  if (!busy)
+  {
+    loop_->cancel(timerId_);
+    timerId_ = -1;
+  }
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "TokenBucket.h"
+#include "Callbacks.h"
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+class EventLoop;
+
+/**
+ * 每个loop一个的限速器(EventLoop::trafficShaper())，只在loop线程中使用。
+ * 管理本loop上所有限速连接的令牌桶和按租户共享的令牌桶，用一个loop级的定时器统一补充令牌，
+ * 并恢复因令牌耗尽而暂停读/写的连接。所有桶都满且没有暂停的连接时定时器停掉，不限速时没有开销。
+ */
+class TrafficShaper : noncopyable
+{
+public:
+  // 同一loop上同名租户的连接共用这一对桶，rate<=0表示该方向不限
+  struct Tenant
+  {
+    explicit Tenant(double tick) : members(0), tickSeconds(tick) {}
+
+    // 一次最多从租户桶里取一个tick补充量的平均份额(至少1KB)，
+    // 不然epoll里排在前面的连接每次都会把刚补充的令牌用光
+    size_t share(const TokenBucket &bucket) const
+    {
+      int n = std::max(members.load(std::memory_order_relaxed), 1);
+      return std::max(static_cast<size_t>(bucket.rate() * tickSeconds / n), static_cast<size_t>(1024));
+    }
+
+    std::unique_ptr<TokenBucket> read;
+    std::unique_ptr<TokenBucket> write;
+    std::atomic_int members; // 属于该租户的连接数，连接迁走时在新loop线程里减
+    const double tickSeconds;
+  };
+  using TenantPtr = std::shared_ptr<Tenant>;
+
+  // 由EventLoop创建并持有，定时器随loop一起销毁
+  explicit TrafficShaper(EventLoop *loop, double tickSeconds = 0.01);
+
+  // 租户限速是每个loop各自的，多个loop上的同名租户各有一份
+  void setTenantLimits(const std::string &name, double readRate, double writeRate, double burst = 0);
+  TenantPtr tenant(const std::string &name);
+
+  // 由TcpConnection在设置了限速或迁移过来时登记，连接销毁后自动移除
+  void add(const TcpConnectionPtr &conn);
+  // 消耗了令牌之后调用，保证定时器在跑
+  void activate()
+  {
+    if (timerId_ < 0)
+    {
+      startTicking();
+    }
+  }
+
+private:
+  void startTicking();
+  void tick();
+
+  EventLoop *loop_;
+  const double tickSeconds_;
+  int64_t timerId_; // 定时器停掉时为-1
+  int64_t lastTickNs_;
+  size_t resumeCursor_;
+  std::map<std::string, TenantPtr> tenants_;
+  std::vector<std::weak_ptr<TcpConnection>> connections_;
+};
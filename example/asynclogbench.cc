@@ -0,0 +1,69 @@
+#include <mymuduo/AsyncLogging.h>
+#include <mymuduo/Logger.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// 多线程通过LOG_INFO写异步日志，统计总吞吐(行/秒)和每次调用给写日志线程增加的延迟分位数
+// 用法: ./asynclogbench [线程数] [每线程行数] [drop|block]
+
+int main(int argc, char *argv[])
+{
+  int numThreads = argc > 1 ? atoi(argv[1]) : 4;
+  int linesPerThread = argc > 2 ? atoi(argv[2]) : 200000;
+  AsyncLogging::OverflowPolicy policy =
+      (argc > 3 && strcmp(argv[3], "block") == 0) ? AsyncLogging::kBlock : AsyncLogging::kDrop;
+
+  AsyncLogging log("/tmp/asynclogbench", 500 * 1000 * 1000, 1, 16, policy);
+  Logger::instance().setOutput(std::bind(&AsyncLogging::append, &log,
+                                         std::placeholders::_1, std::placeholders::_2));
+  log.start();
+
+  std::vector<std::vector<int64_t>> latencies(numThreads);
+  std::vector<std::thread> threads;
+  auto begin = std::chrono::steady_clock::now();
+  for (int t = 0; t < numThreads; ++t)
+  {
+    threads.emplace_back([t, linesPerThread, &latencies]() {
+      std::vector<int64_t> &lat = latencies[t];
+      lat.reserve(linesPerThread);
+      for (int i = 0; i < linesPerThread; ++i)
+      {
+        auto start = std::chrono::steady_clock::now();
+        LOG_INFO("thread %d line %d abcdefghijklmnopqrstuvwxyz 0123456789", t, i);
+        auto end = std::chrono::steady_clock::now();
+        lat.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+      }
+    });
+  }
+  for (std::thread &th : threads)
+  {
+    th.join();
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+  log.stop();
+
+  std::vector<int64_t> all;
+  for (auto &lat : latencies)
+  {
+    all.insert(all.end(), lat.begin(), lat.end());
+  }
+  std::sort(all.begin(), all.end());
+  size_t total = all.size();
+  printf("policy=%s threads=%d lines=%zu time=%.3fs\n",
+         policy == AsyncLogging::kBlock ? "block" : "drop", numThreads, total, seconds);
+  printf("throughput: %.0f lines/s\n", total / seconds);
+  printf("caller latency ns: p50=%lld p99=%lld p999=%lld max=%lld\n",
+         (long long)all[total / 2], (long long)all[total * 99 / 100],
+         (long long)all[total * 999 / 1000], (long long)all[total - 1]);
+  printf("dropped lines: %llu\n", (unsigned long long)log.droppedLines());
+  return 0;
+}
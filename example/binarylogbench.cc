@@ -0,0 +1,65 @@
+#include <mymuduo/Logger.h>
+#include <mymuduo/BinaryLog.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// 二进制日志热路径的耗时：编译时定义MYMUDUO_BINARY_LOG，LOG_INFO只拷贝参数，格式化在后台线程
+// 每批调用后等后台线程读完再继续，只统计调用线程上的耗时
+// 用法: ./binarylogbench [批数] [每批行数]
+
+static std::atomic<uint64_t> g_lines(0);
+
+// 用线程cpu时间计时，单核机器上后台线程抢占调用线程的时间不算进来
+static int64_t threadCpuNs()
+{
+  timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+int main(int argc, char *argv[])
+{
+  int batches = argc > 1 ? atoi(argv[1]) : 200;
+  int perBatch = argc > 2 ? atoi(argv[2]) : 5000;
+
+  // 先在同步模式下输出几行，确认格式化结果和snprintf一致
+  LOG_INFO("sample int=%d long=%ld str=%s double=%.3f ptr=%p hex=%#x", -42, 1234567890123L, "hello", 3.14159, (void *)&batches, 255);
+
+  Logger::instance().setOutput([](const char *, size_t) { ++g_lines; });
+  BinaryLog::start();
+
+  const char *peer = "127.0.0.1:54321";
+  std::vector<double> batchNs;
+  for (int b = 0; b < batches; ++b)
+  {
+    int64_t start = threadCpuNs();
+    for (int i = 0; i < perBatch; ++i)
+    {
+      LOG_INFO("conn %s fd=%d read %ld bytes seq=%d", peer, 17, 4096L, i);
+    }
+    int64_t end = threadCpuNs();
+    batchNs.push_back(static_cast<double>(end - start) / perBatch);
+    // 等后台线程追上，避免环满丢日志
+    uint64_t expect = static_cast<uint64_t>(b + 1) * perBatch - BinaryLog::droppedLines();
+    while (g_lines < expect)
+    {
+      std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+  }
+  BinaryLog::stop();
+
+  std::sort(batchNs.begin(), batchNs.end());
+  printf("lines=%llu dropped=%llu\n", (unsigned long long)g_lines.load(),
+         (unsigned long long)BinaryLog::droppedLines());
+  printf("ns per call: p50=%.1f p99=%.1f min=%.1f max=%.1f (batch averages)\n",
+         batchNs[batchNs.size() / 2], batchNs[batchNs.size() * 99 / 100], batchNs.front(), batchNs.back());
+  return 0;
+}
@@ -0,0 +1,188 @@
+#include <mymuduo/TcpServer.h>
+#include <mymuduo/Logger.h>
+#include <mymuduo/Payload.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+// 跨线程广播：业务线程把一批消息发给所有连接
+// per-conn: 业务线程自己维护连接表，对每个连接调用conn->send，每个连接每条消息一个跨线程任务
+// registry: server.registry().broadcast，每条消息每个loop一个任务
+// 用法: ./broadcastbench [连接数] [subloop数] [消息条数] [消息字节数]
+
+namespace
+{
+  const int kClientThreads = 2;
+
+  int g_numConns = 4000;
+  int g_numLoops = 4;
+  int g_numMessages = 50;
+  size_t g_msgSize = 64;
+
+  std::mutex g_mutex;
+  std::vector<TcpConnectionPtr> g_conns; // 业务线程自己维护的连接表，g_mutex保护
+
+  void onConnection(const TcpConnectionPtr &conn)
+  {
+    std::unique_lock<std::mutex> lock(g_mutex);
+    if (conn->connected())
+    {
+      g_conns.push_back(conn);
+    }
+  }
+
+  void receive(const std::vector<int> &fds, std::atomic<int64_t> *remaining)
+  {
+    int epfd = ::epoll_create1(EPOLL_CLOEXEC);
+    for (int fd : fds)
+    {
+      epoll_event ev;
+      ev.events = EPOLLIN;
+      ev.data.fd = fd;
+      ::epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+    }
+    std::vector<epoll_event> events(256);
+    std::vector<char> buf(64 * 1024);
+    while (remaining->load(std::memory_order_relaxed) > 0)
+    {
+      int n = ::epoll_wait(epfd, events.data(), static_cast<int>(events.size()), 100);
+      for (int i = 0; i < n; ++i)
+      {
+        ssize_t got = ::recv(events[i].data.fd, buf.data(), buf.size(), MSG_DONTWAIT);
+        if (got > 0)
+        {
+          remaining->fetch_sub(got, std::memory_order_relaxed);
+        }
+      }
+    }
+    ::close(epfd);
+  }
+
+  void runRound(bool registry, TcpServer *server, const std::vector<std::vector<int>> &clientFds)
+  {
+    std::atomic<int64_t> remaining(static_cast<int64_t>(g_numConns) * g_numMessages * static_cast<int64_t>(g_msgSize));
+    std::vector<std::thread> threads;
+    for (const auto &fds : clientFds)
+    {
+      threads.emplace_back(receive, std::cref(fds), &remaining);
+    }
+
+    LoopMetrics before = server->threadPool()->metrics();
+    auto begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < g_numMessages; ++i)
+    {
+      Payload payload = Payload::copyOf(std::string(g_msgSize, static_cast<char>('a' + i % 26)).data(), g_msgSize);
+      if (registry)
+      {
+        server->registry().broadcast(payload);
+      }
+      else
+      {
+        std::unique_lock<std::mutex> lock(g_mutex);
+        for (const TcpConnectionPtr &conn : g_conns)
+        {
+          conn->send(payload);
+        }
+      }
+    }
+    double publishSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    for (std::thread &t : threads)
+    {
+      t.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    LoopMetrics after = server->threadPool()->metrics();
+
+    printf("%-8s publish %8.2f ms  delivered in %8.2f ms  loop tasks %8llu  wakeups %7llu  iterations %7llu\n",
+           registry ? "registry" : "per-conn", publishSeconds * 1000, seconds * 1000,
+           static_cast<unsigned long long>(after.functorsRun - before.functorsRun),
+           static_cast<unsigned long long>(after.wakeups - before.wakeups),
+           static_cast<unsigned long long>(after.iterations - before.iterations));
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  g_numConns = argc > 1 ? atoi(argv[1]) : 4000;
+  g_numLoops = argc > 2 ? atoi(argv[2]) : 4;
+  g_numMessages = argc > 3 ? atoi(argv[3]) : 50;
+  g_msgSize = argc > 4 ? static_cast<size_t>(atoi(argv[4])) : 64;
+  Logger::setLogLevel(ERROR);
+
+  InetAddress addr(19400);
+  EventLoop *baseLoop = nullptr;
+  TcpServer *server = nullptr;
+  std::atomic_bool ready(false);
+  std::thread serverThread([&]()
+                           {
+    EventLoop loop;
+    TcpServer s(&loop, addr, "broadcastbench");
+    s.setThreadNum(g_numLoops);
+    s.setConnectionCallback(onConnection);
+    s.start();
+    baseLoop = &loop;
+    server = &s;
+    ready = true;
+    loop.loop(); });
+  while (!ready)
+  {
+    usleep(1000);
+  }
+
+  std::vector<std::vector<int>> clientFds(kClientThreads);
+  for (int i = 0; i < g_numConns; ++i)
+  {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (::connect(fd, (const sockaddr *)addr.getSockAddr(), sizeof(sockaddr_in)) < 0)
+    {
+      perror("connect");
+      exit(1);
+    }
+    clientFds[i % kClientThreads].push_back(fd);
+  }
+  while (server->registry().size() < static_cast<size_t>(g_numConns))
+  {
+    usleep(1000);
+  }
+  while (true)
+  {
+    std::unique_lock<std::mutex> lock(g_mutex);
+    if (g_conns.size() >= static_cast<size_t>(g_numConns))
+    {
+      break;
+    }
+    lock.unlock();
+    usleep(1000);
+  }
+
+  printf("%d connections on %d loops, %d messages of %zu bytes\n", g_numConns, g_numLoops, g_numMessages, g_msgSize);
+  for (int round = 0; round < 2; ++round)
+  {
+    runRound(false, server, clientFds);
+    runRound(true, server, clientFds);
+  }
+
+  {
+    std::unique_lock<std::mutex> lock(g_mutex);
+    g_conns.clear();
+  }
+  for (const auto &fds : clientFds)
+  {
+    for (int fd : fds)
+    {
+      ::close(fd);
+    }
+  }
+  baseLoop->quit();
+  serverThread.join();
+  return 0;
+}
@@ -0,0 +1,232 @@
+#include <mymuduo/TcpServer.h>
+#include <mymuduo/Logger.h>
+#include <mymuduo/Payload.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+// 广播扇出：同一批消息发给所有连接，对比逐连接拷贝(send(string))和共享数据块(send(Payload))
+// 服务端单个loop，在一个回调里连续发布一批消息(模拟突发)，之后客户端才用几个线程epoll收完全部数据
+// 发布期间loop不处理可写事件，发布结束时发送队列里的字节就是用户态要拷贝(或引用)的量
+// 用法: ./fanoutbench [连接数] [消息字节数] [消息条数]
+
+namespace
+{
+  const int kClientThreads = 4;
+
+  int g_numConns = 1000;
+  size_t g_msgSize = 4096;
+  int g_numMessages = 64;
+
+  EventLoop *g_loop = nullptr;
+  std::vector<TcpConnectionPtr> g_conns; // 只在服务端loop线程中访问
+  std::atomic_int g_connected(0);
+
+  void onConnection(const TcpConnectionPtr &conn)
+  {
+    if (conn->connected())
+    {
+      g_conns.push_back(conn);
+      ++g_connected;
+    }
+  }
+
+  struct PublishResult
+  {
+    double seconds;
+    int64_t cpuMicros;
+    int64_t queuedBytes; // 发布结束时发送队列里的字节数
+    int64_t memoryBytes; // 发布结束时发送队列实际占用的内存
+  };
+
+  // 在loop线程中连续发布全部消息
+  PublishResult publishAll(bool shared)
+  {
+    const int64_t baseline = MemoryBudget::process()->used();
+    PublishResult result;
+    std::vector<std::shared_ptr<const std::string>> blocks;
+    auto begin = std::chrono::steady_clock::now();
+    int64_t cpuBegin = g_loop->cpuTimeMicros();
+    for (int i = 0; i < g_numMessages; ++i)
+    {
+      std::string msg(g_msgSize, static_cast<char>('a' + i % 26));
+      if (shared)
+      {
+        std::shared_ptr<const std::string> block = std::make_shared<std::string>(std::move(msg));
+        blocks.push_back(block);
+        Payload payload(block);
+        for (const TcpConnectionPtr &conn : g_conns)
+        {
+          conn->send(payload);
+        }
+      }
+      else
+      {
+        for (const TcpConnectionPtr &conn : g_conns)
+        {
+          conn->send(msg);
+        }
+      }
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    result.cpuMicros = g_loop->cpuTimeMicros() - cpuBegin;
+    result.queuedBytes = g_loop->pendingBytes();
+    if (shared)
+    {
+      // 还被发送队列引用着的数据块
+      result.memoryBytes = 0;
+      for (const auto &block : blocks)
+      {
+        result.memoryBytes += block.use_count() > 1 ? static_cast<int64_t>(g_msgSize) : 0;
+      }
+    }
+    else
+    {
+      result.memoryBytes = MemoryBudget::process()->used() - baseline;
+    }
+    return result;
+  }
+
+  // 客户端线程：收完每个连接上的全部消息
+  void receive(const std::vector<int> &fds, std::atomic<int64_t> *remaining)
+  {
+    int epfd = ::epoll_create1(EPOLL_CLOEXEC);
+    for (int fd : fds)
+    {
+      epoll_event ev;
+      ev.events = EPOLLIN;
+      ev.data.fd = fd;
+      ::epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+    }
+    std::vector<epoll_event> events(256);
+    std::vector<char> buf(256 * 1024);
+    while (remaining->load(std::memory_order_relaxed) > 0)
+    {
+      int n = ::epoll_wait(epfd, events.data(), static_cast<int>(events.size()), 100);
+      for (int i = 0; i < n; ++i)
+      {
+        ssize_t got = ::recv(events[i].data.fd, buf.data(), buf.size(), MSG_DONTWAIT);
+        if (got > 0)
+        {
+          remaining->fetch_sub(got, std::memory_order_relaxed);
+        }
+      }
+    }
+    ::close(epfd);
+  }
+
+  void runRound(bool shared, const std::vector<std::vector<int>> &clientFds)
+  {
+    std::atomic<int64_t> remaining(static_cast<int64_t>(g_numConns) * g_numMessages * static_cast<int64_t>(g_msgSize));
+    auto begin = std::chrono::steady_clock::now();
+    PublishResult result;
+    std::atomic_bool published(false);
+    g_loop->runInLoop([&]()
+                      {
+      result = publishAll(shared);
+      published = true; });
+    // 订阅者在突发结束后才开始收
+    while (!published)
+    {
+      usleep(100);
+    }
+    std::vector<std::thread> threads;
+    for (const auto &fds : clientFds)
+    {
+      threads.emplace_back(receive, std::cref(fds), &remaining);
+    }
+    for (std::thread &t : threads)
+    {
+      t.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    const double mb = 1024.0 * 1024;
+    const double total = static_cast<double>(g_numConns) * g_numMessages * g_msgSize;
+    // 拷贝模式下排进队列的字节都被memcpy过一次
+    printf("%-7s publish %8.0f msgs/s (loop cpu %6.1f ms)  queued %7.1f MB  copied %7.1f MB (%5.2f GB/s)  queue memory %7.1f MB  delivered %7.1f MB/s\n",
+           shared ? "shared" : "copy", g_numConns * g_numMessages / result.seconds, result.cpuMicros / 1000.0,
+           result.queuedBytes / mb, shared ? 0.0 : result.queuedBytes / mb,
+           shared ? 0.0 : result.queuedBytes / result.seconds / (1024 * mb), result.memoryBytes / mb, total / mb / seconds);
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  g_numConns = argc > 1 ? atoi(argv[1]) : 1000;
+  g_msgSize = argc > 2 ? static_cast<size_t>(atoi(argv[2])) : 4096;
+  g_numMessages = argc > 3 ? atoi(argv[3]) : 64;
+  Logger::setLogLevel(ERROR);
+
+  InetAddress addr(19300);
+  std::atomic_bool ready(false);
+  std::thread server([&]()
+                     {
+    EventLoop loop;
+    // 固定较小的发送缓冲区(关掉内核的自动调整)，突发的消息大部分要在服务端的发送队列里排队
+    int listenFd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int on = 1;
+    int sndbuf = 16 * 1024;
+    ::setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof on);
+    ::setsockopt(listenFd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof sndbuf);
+    if (::bind(listenFd, (const sockaddr *)addr.getSockAddr(), sizeof(sockaddr_in)) < 0)
+    {
+      perror("bind");
+      exit(1);
+    }
+    TcpServer server(&loop, listenFd, "fanoutbench");
+    server.setConnectionCallback(onConnection);
+    server.start();
+    g_loop = &loop;
+    ready = true;
+    loop.loop();
+    g_conns.clear(); });
+  while (!ready)
+  {
+    usleep(1000);
+  }
+
+  std::vector<std::vector<int>> clientFds(kClientThreads);
+  for (int i = 0; i < g_numConns; ++i)
+  {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    int rcvbuf = 16 * 1024;
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof rcvbuf);
+    if (::connect(fd, (const sockaddr *)addr.getSockAddr(), sizeof(sockaddr_in)) < 0)
+    {
+      perror("connect");
+      exit(1);
+    }
+    clientFds[i % kClientThreads].push_back(fd);
+  }
+  while (g_connected < g_numConns)
+  {
+    usleep(1000);
+  }
+
+  printf("%d connections, %zu-byte messages, %d messages each\n", g_numConns, g_msgSize, g_numMessages);
+  runRound(false, clientFds);
+  runRound(true, clientFds);
+
+  for (const auto &fds : clientFds)
+  {
+    for (int fd : fds)
+    {
+      ::close(fd);
+    }
+  }
+  g_loop->quit();
+  server.join();
+  return 0;
+}
@@ -0,0 +1,189 @@
+#include <mymuduo/TcpServer.h>
+#include <mymuduo/Logger.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+// 运行时增减subloop(TcpServer::addLoop/removeLoop)时连接被迁移，检查回显的数据既不丢也不乱序
+// 每个客户端不停地发一段随机长度(最长8MB)的字节流，字节由客户端自己的序号算出，收回显时逐字节核对；
+// 一半的数据块发完才开始收(客户端的接收缓冲区也调小了)，超过内核收发缓冲区的部分积压在服务端的outputBuffer里，
+// 迁移时正好有数据在途，也覆盖了积压时追加发送的路径
+// 有任何字节丢失、错位、连接被断开或5秒收不到回显时返回非0
+// 用法: ./resizebench [增减次数] [客户端数] [初始subloop数]
+
+namespace
+{
+  const size_t kMaxChunk = 8 * 1024 * 1024; // 大于loopback上内核收发缓冲区之和
+  const int kClientRcvBuf = 64 * 1024;
+
+  int g_resizes = 20;
+  int g_numClients = 8;
+  int g_numLoops = 3;
+
+  std::atomic_bool g_stop(false);
+  std::atomic<uint64_t> g_bytes(0);
+  std::atomic_int g_errors(0);
+
+  inline unsigned char patternByte(uint32_t seq) { return static_cast<unsigned char>(seq * 31 + (seq >> 8)); }
+
+  void client(uint16_t port, int id)
+  {
+    InetAddress addr(port);
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &kClientRcvBuf, sizeof kClientRcvBuf);
+    if (::connect(fd, (const sockaddr *)addr.getSockAddr(), sizeof(sockaddr_in)) < 0)
+    {
+      perror("connect");
+      ++g_errors;
+      return;
+    }
+    unsigned int seed = static_cast<unsigned int>(id) + 1;
+    uint32_t sendSeq = static_cast<uint32_t>(id) * 7919;
+    uint32_t recvSeq = sendSeq;
+    std::vector<unsigned char> out(kMaxChunk);
+    std::vector<unsigned char> in(kMaxChunk);
+    while (!g_stop)
+    {
+      size_t len = 1 + ::rand_r(&seed) % kMaxChunk;
+      bool lazy = ::rand_r(&seed) % 2 == 0; // 发完才开始收
+      for (size_t i = 0; i < len; ++i)
+      {
+        out[i] = patternByte(sendSeq++);
+      }
+      size_t sent = 0;
+      size_t got = 0;
+      while (got < len)
+      {
+        pollfd pfd;
+        pfd.fd = fd;
+        pfd.events = static_cast<short>((lazy && sent < len ? 0 : POLLIN) | (sent < len ? POLLOUT : 0));
+        pfd.revents = 0;
+        if (::poll(&pfd, 1, 5000) <= 0)
+        {
+          fprintf(stderr, "client %d: no echo for 5s, sent %zu got %zu of %zu\n", id, sent, got, len);
+          ++g_errors;
+          ::close(fd);
+          return;
+        }
+        if (pfd.revents & POLLOUT)
+        {
+          ssize_t n = ::write(fd, out.data() + sent, len - sent);
+          if (n > 0)
+          {
+            sent += n;
+          }
+        }
+        if (pfd.revents & (POLLIN | POLLHUP | POLLERR))
+        {
+          ssize_t n = ::read(fd, in.data() + got, len - got);
+          if (n <= 0)
+          {
+            fprintf(stderr, "client %d: connection closed\n", id);
+            ++g_errors;
+            ::close(fd);
+            return;
+          }
+          for (ssize_t i = 0; i < n; ++i)
+          {
+            if (in[got + i] != patternByte(recvSeq++))
+            {
+              fprintf(stderr, "client %d: byte %zu of chunk is lost or out of order\n", id, got + i);
+              ++g_errors;
+              ::close(fd);
+              return;
+            }
+          }
+          got += n;
+        }
+      }
+      g_bytes += len;
+    }
+    ::close(fd);
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  g_resizes = argc > 1 ? atoi(argv[1]) : 20;
+  g_numClients = argc > 2 ? atoi(argv[2]) : 8;
+  g_numLoops = argc > 3 ? atoi(argv[3]) : 3;
+  if (g_numLoops < 2)
+  {
+    g_numLoops = 2;
+  }
+  Logger::setLogLevel(ERROR);
+  ::signal(SIGPIPE, SIG_IGN); // 客户端出错时先关连接，服务端不能因此被SIGPIPE杀掉
+  const uint16_t port = 19800;
+
+  EventLoop *baseLoop = nullptr;
+  TcpServer *server = nullptr;
+  std::atomic_bool ready(false);
+  std::thread serverThread([&]()
+                           {
+    EventLoop loop;
+    TcpServer s(&loop, InetAddress(port), "resizebench");
+    s.setThreadNum(g_numLoops);
+    s.setLoadBalanceStrategy(LoadBalancer::kLeastConnections);
+    s.setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+                         { conn->send(buf->retrieveAllAsString()); });
+    s.start();
+    baseLoop = &loop;
+    server = &s;
+    ready = true;
+    loop.loop(); });
+  while (!ready)
+  {
+    usleep(1000);
+  }
+
+  std::vector<std::thread> clients;
+  for (int i = 0; i < g_numClients; ++i)
+  {
+    clients.emplace_back(client, port, i);
+  }
+
+  // 在1个和g_numLoops个subloop之间来回增减，每次都有连接被迁走
+  int loops = g_numLoops;
+  bool shrinking = true;
+  for (int i = 0; i < g_resizes; ++i)
+  {
+    usleep(100 * 1000);
+    if (shrinking)
+    {
+      server->removeLoop();
+      shrinking = --loops > 1;
+    }
+    else
+    {
+      server->addLoop();
+      shrinking = ++loops >= g_numLoops;
+    }
+  }
+  usleep(300 * 1000);
+  g_stop = true;
+  for (std::thread &t : clients)
+  {
+    t.join();
+  }
+
+  // 等连接都断开再退出，不在连接还活着时析构server
+  while (server->registry().size() > 0)
+  {
+    usleep(1000);
+  }
+  size_t finalLoops = server->threadPool()->getAllLoops().size();
+  baseLoop->quit();
+  serverThread.join();
+
+  printf("%d resizes, %d clients, echoed %.1f MB, %zu loops at exit, errors %d\n", g_resizes, g_numClients,
+         g_bytes.load() / (1024.0 * 1024), finalLoops, g_errors.load());
+  return g_errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,239 @@
+#include <mymuduo/TcpServer.h>
+#include <mymuduo/Handoff.h>
+#include <mymuduo/Logger.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+// 不停机重启：压测过程中反复拉起新进程接管监听socket和空闲连接(TcpServer::enableHandoff/Handoff::takeOver)，
+// 统计被拒绝的connect次数和失败的请求数，任何一个不为0时返回非0
+// 短连接线程不停地connect、发一个ping、收回显后关闭；长连接线程在一组连接上轮流ping，连接应当被交接给新进程
+// 用法: ./restartbench [重启次数] [端口]
+// 内部用 ./restartbench serve <端口> 作为服务端进程
+
+namespace
+{
+  const int kShortClients = 4;
+  const int kLongConnections = 10;
+  const double kDrainTimeout = 2.0;
+
+  uint16_t g_port = 19600;
+  std::string g_handoffPath;
+
+  std::atomic_bool g_stop(false);
+  std::atomic<uint64_t> g_connects(0);
+  std::atomic<uint64_t> g_refused(0);
+  std::atomic<uint64_t> g_requests(0);
+  std::atomic<uint64_t> g_failures(0);
+
+  // 服务端进程：有旧进程时接管它的监听socket和空闲连接，然后等下一个进程来接管自己
+  int serve()
+  {
+    Logger::setLogLevel(ERROR);
+    EventLoop loop;
+    Handoff::Inherited inherited;
+    std::unique_ptr<TcpServer> server;
+    if (Handoff::takeOver(g_handoffPath, &inherited) && inherited.listenFd >= 0)
+    {
+      server.reset(new TcpServer(&loop, inherited.listenFd, "restartbench"));
+    }
+    else
+    {
+      server.reset(new TcpServer(&loop, InetAddress(g_port), "restartbench"));
+    }
+    server->setThreadNum(2);
+    server->setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+                               { conn->send(buf->retrieveAllAsString()); });
+    server->start();
+    for (const auto &item : inherited.connections)
+    {
+      server->adoptConnection(item.first, item.second);
+    }
+    server->enableHandoff(g_handoffPath, true, kDrainTimeout);
+    loop.loop();
+    return 0;
+  }
+
+  pid_t spawnServer()
+  {
+    pid_t pid = ::fork();
+    if (pid == 0)
+    {
+      std::string port = std::to_string(g_port);
+      ::execl("/proc/self/exe", "restartbench", "serve", port.c_str(), static_cast<char *>(nullptr));
+      ::_exit(127);
+    }
+    return pid;
+  }
+
+  int connectServer()
+  {
+    InetAddress addr(g_port);
+    int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (::connect(fd, (const sockaddr *)addr.getSockAddr(), sizeof(sockaddr_in)) < 0)
+    {
+      ::close(fd);
+      return -1;
+    }
+    timeval tv = {5, 0};
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof tv);
+    return fd;
+  }
+
+  bool ping(int fd)
+  {
+    if (::write(fd, "ping", 4) != 4)
+    {
+      return false;
+    }
+    char buf[4];
+    size_t got = 0;
+    while (got < sizeof buf)
+    {
+      ssize_t n = ::read(fd, buf + got, sizeof buf - got);
+      if (n <= 0)
+      {
+        return false;
+      }
+      got += n;
+    }
+    return memcmp(buf, "ping", 4) == 0;
+  }
+
+  void shortClient()
+  {
+    while (!g_stop)
+    {
+      int fd = connectServer();
+      ++g_connects;
+      if (fd < 0)
+      {
+        ++g_refused;
+        continue;
+      }
+      ++g_requests;
+      if (!ping(fd))
+      {
+        ++g_failures;
+      }
+      ::close(fd);
+    }
+  }
+
+  void longClient()
+  {
+    std::vector<int> fds;
+    for (int i = 0; i < kLongConnections; ++i)
+    {
+      int fd = connectServer();
+      ++g_connects;
+      if (fd < 0)
+      {
+        ++g_refused;
+        continue;
+      }
+      fds.push_back(fd);
+    }
+    while (!g_stop)
+    {
+      for (int fd : fds)
+      {
+        ++g_requests;
+        if (!ping(fd))
+        {
+          ++g_failures;
+        }
+      }
+      ::usleep(20 * 1000);
+    }
+    for (int fd : fds)
+    {
+      ::close(fd);
+    }
+  }
+
+  // 回收已经排空退出的旧进程
+  void reap()
+  {
+    int status = 0;
+    pid_t pid;
+    while ((pid = ::waitpid(-1, &status, WNOHANG)) > 0)
+    {
+      if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+      {
+        fprintf(stderr, "server %d exited abnormally, status %d\n", pid, status);
+        ++g_failures;
+      }
+    }
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  if (argc > 2 && strcmp(argv[1], "serve") == 0)
+  {
+    g_port = static_cast<uint16_t>(atoi(argv[2]));
+    g_handoffPath = "/tmp/restartbench." + std::to_string(g_port) + ".sock";
+    return serve();
+  }
+  int restarts = argc > 1 ? atoi(argv[1]) : 5;
+  g_port = static_cast<uint16_t>(argc > 2 ? atoi(argv[2]) : 19600);
+  g_handoffPath = "/tmp/restartbench." + std::to_string(g_port) + ".sock";
+  ::unlink(g_handoffPath.c_str());
+
+  pid_t current = spawnServer();
+  int fd = -1;
+  for (int i = 0; i < 1000 && (fd = connectServer()) < 0; ++i)
+  {
+    ::usleep(10 * 1000);
+  }
+  if (fd < 0)
+  {
+    fprintf(stderr, "server did not start\n");
+    ::kill(current, SIGKILL);
+    return 1;
+  }
+  ::close(fd);
+
+  std::vector<std::thread> clients;
+  for (int i = 0; i < kShortClients; ++i)
+  {
+    clients.emplace_back(shortClient);
+  }
+  clients.emplace_back(longClient);
+
+  for (int i = 0; i < restarts; ++i)
+  {
+    ::sleep(1);
+    current = spawnServer(); // 新进程接管后，旧进程排空剩余连接再退出
+    reap();
+  }
+  ::sleep(1);
+  g_stop = true;
+  for (std::thread &t : clients)
+  {
+    t.join();
+  }
+
+  // 最后一个进程没有接班人，直接结束；等前面的进程都排空退出
+  ::kill(current, SIGTERM);
+  ::waitpid(current, nullptr, 0);
+  ::sleep(static_cast<unsigned>(kDrainTimeout) + 1);
+  reap();
+  ::unlink(g_handoffPath.c_str());
+
+  printf("restarts %d  connects %llu  refused %llu  requests %llu  failures %llu\n", restarts,
+         static_cast<unsigned long long>(g_connects.load()), static_cast<unsigned long long>(g_refused.load()),
+         static_cast<unsigned long long>(g_requests.load()), static_cast<unsigned long long>(g_failures.load()));
+  return g_refused == 0 && g_failures == 0 ? 0 : 1;
+}
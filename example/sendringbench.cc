@@ -0,0 +1,241 @@
+#include <mymuduo/TcpServer.h>
+#include <mymuduo/Logger.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+// 业务线程往连接上发响应：对比投递任务(默认)和发送环(TcpConnection::enableSendRing)
+// 每个业务线程轮流给各连接发小消息，消息里带线程号和该线程在这个连接上的序号，
+// 客户端检查同一线程的消息既没有交错也没有乱序
+// 用法: ./sendringbench [连接数] [业务线程数] [每线程消息数] [消息字节数] [发送环字节数]
+
+namespace
+{
+  const int kClientThreads = 2;
+
+  int g_numConns = 200;
+  int g_numWorkers = 4;
+  int g_numMessages = 200000;
+  size_t g_msgSize = 32;
+  size_t g_ringSize = 64 * 1024;
+
+  std::mutex g_mutex;
+  std::vector<TcpConnectionPtr> g_conns; // g_mutex保护
+  bool g_ring = false;
+
+  void onConnection(const TcpConnectionPtr &conn)
+  {
+    if (conn->connected())
+    {
+      if (g_ring)
+      {
+        conn->enableSendRing(g_ringSize); // 交给业务线程之前开启
+      }
+      std::unique_lock<std::mutex> lock(g_mutex);
+      g_conns.push_back(conn);
+    }
+  }
+
+  // 消息格式: 线程号(1字节) 序号(4字节) 填充
+  void produce(int worker, const std::vector<TcpConnectionPtr> *conns)
+  {
+    std::vector<uint32_t> seqs(conns->size(), 0);
+    std::string msg(g_msgSize, 'x');
+    for (int i = 0; i < g_numMessages; ++i)
+    {
+      size_t index = (i + worker) % conns->size();
+      msg[0] = static_cast<char>(worker);
+      memcpy(&msg[1], &seqs[index], sizeof(uint32_t));
+      ++seqs[index];
+      (*conns)[index]->send(msg);
+    }
+  }
+
+  struct ClientConn
+  {
+    std::string partial;
+    std::vector<uint32_t> expected;
+  };
+
+  void receive(const std::vector<int> &fds, std::atomic<int64_t> *remaining, std::atomic_int *errors)
+  {
+    int epfd = ::epoll_create1(EPOLL_CLOEXEC);
+    std::vector<ClientConn> state(fds.size());
+    for (size_t i = 0; i < fds.size(); ++i)
+    {
+      state[i].expected.assign(g_numWorkers, 0);
+      epoll_event ev;
+      ev.events = EPOLLIN;
+      ev.data.u64 = i;
+      ::epoll_ctl(epfd, EPOLL_CTL_ADD, fds[i], &ev);
+    }
+    std::vector<epoll_event> events(256);
+    std::vector<char> buf(256 * 1024);
+    while (remaining->load(std::memory_order_relaxed) > 0)
+    {
+      int n = ::epoll_wait(epfd, events.data(), static_cast<int>(events.size()), 100);
+      for (int i = 0; i < n; ++i)
+      {
+        ClientConn &c = state[events[i].data.u64];
+        ssize_t got = ::recv(fds[events[i].data.u64], buf.data(), buf.size(), MSG_DONTWAIT);
+        if (got <= 0)
+        {
+          continue;
+        }
+        remaining->fetch_sub(got, std::memory_order_relaxed);
+        c.partial.append(buf.data(), got);
+        size_t off = 0;
+        for (; off + g_msgSize <= c.partial.size(); off += g_msgSize)
+        {
+          int worker = static_cast<unsigned char>(c.partial[off]);
+          uint32_t seq = 0;
+          memcpy(&seq, &c.partial[off + 1], sizeof seq);
+          if (worker >= g_numWorkers || seq != c.expected[worker])
+          {
+            ++*errors;
+          }
+          else
+          {
+            ++c.expected[worker];
+          }
+        }
+        c.partial.erase(0, off);
+      }
+    }
+    ::close(epfd);
+  }
+
+  void runRound(bool ring, uint16_t port)
+  {
+    g_ring = ring;
+    EventLoop *baseLoop = nullptr;
+    TcpServer *server = nullptr;
+    std::atomic_bool ready(false);
+    std::thread serverThread([&]()
+                             {
+      EventLoop loop;
+      TcpServer s(&loop, InetAddress(port), "sendringbench");
+      s.setThreadNum(2);
+      s.setConnectionCallback(onConnection);
+      s.start();
+      baseLoop = &loop;
+      server = &s;
+      ready = true;
+      loop.loop(); });
+    while (!ready)
+    {
+      usleep(1000);
+    }
+
+    InetAddress addr(port);
+    std::vector<std::vector<int>> clientFds(kClientThreads);
+    for (int i = 0; i < g_numConns; ++i)
+    {
+      int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+      if (::connect(fd, (const sockaddr *)addr.getSockAddr(), sizeof(sockaddr_in)) < 0)
+      {
+        perror("connect");
+        exit(1);
+      }
+      clientFds[i % kClientThreads].push_back(fd);
+    }
+    std::vector<TcpConnectionPtr> conns;
+    while (conns.size() < static_cast<size_t>(g_numConns))
+    {
+      usleep(1000);
+      std::unique_lock<std::mutex> lock(g_mutex);
+      conns = g_conns;
+    }
+
+    std::atomic<int64_t> remaining(static_cast<int64_t>(g_numWorkers) * g_numMessages * static_cast<int64_t>(g_msgSize));
+    std::atomic_int errors(0);
+    std::vector<std::thread> clients;
+    for (const auto &fds : clientFds)
+    {
+      clients.emplace_back(receive, std::cref(fds), &remaining, &errors);
+    }
+
+    LoopMetrics before = server->threadPool()->metrics();
+    auto begin = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (int w = 0; w < g_numWorkers; ++w)
+    {
+      workers.emplace_back(produce, w, &conns);
+    }
+    for (std::thread &t : workers)
+    {
+      t.join();
+    }
+    double produceSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    for (std::thread &t : clients)
+    {
+      t.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    LoopMetrics after = server->threadPool()->metrics();
+    ConnectionStats stats;
+    for (const TcpConnectionPtr &conn : conns)
+    {
+      stats.merge(conn->stats());
+    }
+
+    const double total = static_cast<double>(g_numWorkers) * g_numMessages;
+    printf("%-5s produce %9.0f msgs/s  delivered %9.0f msgs/s  loop tasks %8llu  wakeups %7llu  write calls %8llu  errors %d\n",
+           ring ? "ring" : "task", total / produceSeconds, total / seconds,
+           static_cast<unsigned long long>(after.functorsRun - before.functorsRun),
+           static_cast<unsigned long long>(after.wakeups - before.wakeups),
+           static_cast<unsigned long long>(stats.writeCalls), errors.load());
+
+    conns.clear();
+    {
+      std::unique_lock<std::mutex> lock(g_mutex);
+      g_conns.clear();
+    }
+    for (const auto &fds : clientFds)
+    {
+      for (int fd : fds)
+      {
+        ::close(fd);
+      }
+    }
+    // 等连接都断开再退出，不在连接还活着时析构server
+    while (server->registry().size() > 0)
+    {
+      usleep(1000);
+    }
+    baseLoop->quit();
+    serverThread.join();
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  g_numConns = argc > 1 ? atoi(argv[1]) : 200;
+  g_numWorkers = argc > 2 ? atoi(argv[2]) : 4;
+  g_numMessages = argc > 3 ? atoi(argv[3]) : 200000;
+  g_msgSize = argc > 4 ? static_cast<size_t>(atoi(argv[4])) : 32;
+  g_ringSize = argc > 5 ? static_cast<size_t>(atoi(argv[5])) : 64 * 1024;
+  if (g_msgSize < 5)
+  {
+    g_msgSize = 5;
+  }
+  Logger::setLogLevel(ERROR);
+
+  printf("%d connections, %d workers x %d messages of %zu bytes, ring %zu bytes\n",
+         g_numConns, g_numWorkers, g_numMessages, g_msgSize, g_ringSize);
+  runRound(false, 19500);
+  runRound(true, 19501);
+  runRound(false, 19502);
+  runRound(true, 19503);
+  return 0;
+}
@@ -0,0 +1,254 @@
+#include <mymuduo/TcpServer.h>
+#include <mymuduo/Logger.h>
+#include <mymuduo/TrafficShaper.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// 令牌桶限速的精度和开销
+// 每个场景起若干客户端连接，连接上来先发两个字节说明场景和连接序号：
+//   'd' 不限速持续下发    'D' 每个连接下发限速rate
+//   'U' 每个连接上传限速rate    'T' 所有连接属于同一租户，共享 连接数*rate 的下发限速
+// 统计预热之后每个连接实际达到的速率：下发在客户端数，上传在服务端数(客户端send的量包含填进socket缓冲区的部分)；
+// 服务端loop线程的cpu时间折算成每MB的开销
+// 用法: ./shapingbench [连接数] [每连接速率KB/s] [每场景秒数]
+
+namespace
+{
+  const uint16_t kPort = 19100;
+  const double kWarmupSeconds = 0.5;
+  const std::string kChunk(64 * 1024, 'x');
+
+  const int kMaxConns = 64;
+
+  int g_numConns = 4;
+  double g_rate = 1024 * 1024;
+
+  // 上传场景服务端收到的字节数，按连接序号
+  std::atomic<uint64_t> g_uploaded[kMaxConns];
+
+  // 只在服务端loop线程中访问
+  std::map<std::string, char> g_modes;
+  std::map<std::string, int> g_indexes;
+
+  bool downloading(const TcpConnectionPtr &conn)
+  {
+    auto it = g_modes.find(conn->name());
+    return it != g_modes.end() && it->second != 'U';
+  }
+
+  void onConnection(const TcpConnectionPtr &conn)
+  {
+    if (!conn->connected())
+    {
+      g_modes.erase(conn->name());
+      g_indexes.erase(conn->name());
+    }
+  }
+
+  void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+  {
+    auto it = g_modes.find(conn->name());
+    if (it == g_modes.end())
+    {
+      if (buf->readableBytes() < 2)
+      {
+        return;
+      }
+      char mode = buf->peek()[0];
+      g_modes[conn->name()] = mode;
+      g_indexes[conn->name()] = buf->peek()[1];
+      if (mode == 'D')
+      {
+        conn->setWriteRateLimit(g_rate);
+      }
+      else if (mode == 'U')
+      {
+        conn->setReadRateLimit(g_rate);
+      }
+      else if (mode == 'T')
+      {
+        conn->getLoop()->trafficShaper()->setTenantLimits("bench", 0, g_rate * g_numConns);
+        conn->setTenant("bench");
+      }
+      if (mode != 'U')
+      {
+        conn->send(kChunk);
+        conn->send(kChunk);
+      }
+      buf->retrieve(2);
+    }
+    else if (it->second == 'U')
+    {
+      g_uploaded[g_indexes[conn->name()]] += buf->readableBytes();
+    }
+    buf->retrieveAll();
+  }
+
+  void onWriteComplete(const TcpConnectionPtr &conn)
+  {
+    if (conn->connected() && downloading(conn))
+    {
+      conn->send(kChunk);
+    }
+  }
+
+  int connectServer()
+  {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    ::memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(kPort);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(fd, (sockaddr *)&addr, sizeof addr) < 0)
+    {
+      perror("connect");
+      exit(1);
+    }
+    return fd;
+  }
+
+  // 返回每个连接预热之后的速率(字节/秒)
+  std::vector<double> runClients(char mode, double seconds)
+  {
+    std::vector<double> rates(g_numConns);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < g_numConns; ++i)
+    {
+      threads.emplace_back([i, mode, seconds, &rates]()
+                           {
+        int fd = connectServer();
+        char hello[2] = {mode, static_cast<char>(i)};
+        ::send(fd, hello, sizeof hello, 0);
+        std::vector<char> buf(64 * 1024, 'y');
+        auto begin = std::chrono::steady_clock::now();
+        auto warm = begin + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(kWarmupSeconds));
+        auto end = begin + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(seconds));
+        uint64_t bytes = 0;
+        auto now = begin;
+        while (now < end)
+        {
+          ssize_t n = mode == 'U' ? ::send(fd, buf.data(), buf.size(), 0) : ::recv(fd, buf.data(), buf.size(), 0);
+          if (n <= 0)
+          {
+            break;
+          }
+          now = std::chrono::steady_clock::now();
+          if (now >= warm)
+          {
+            bytes += n;
+          }
+        }
+        if (mode != 'U')
+        {
+          rates[i] = bytes / (seconds - kWarmupSeconds);
+        }
+        ::close(fd); });
+    }
+    if (mode == 'U')
+    {
+      uint64_t warm[kMaxConns];
+      usleep(static_cast<useconds_t>(kWarmupSeconds * 1e6));
+      for (int i = 0; i < g_numConns; ++i)
+      {
+        warm[i] = g_uploaded[i];
+      }
+      usleep(static_cast<useconds_t>((seconds - kWarmupSeconds) * 1e6));
+      for (int i = 0; i < g_numConns; ++i)
+      {
+        rates[i] = (g_uploaded[i] - warm[i]) / (seconds - kWarmupSeconds);
+      }
+    }
+    for (std::thread &t : threads)
+    {
+      t.join();
+    }
+    return rates;
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  g_numConns = std::min(argc > 1 ? atoi(argv[1]) : 4, kMaxConns);
+  g_rate = (argc > 2 ? atof(argv[2]) : 1024) * 1024;
+  double seconds = argc > 3 ? atof(argv[3]) : 3;
+  Logger::setLogLevel(ERROR);
+
+  EventLoop *serverLoop = nullptr;
+  std::atomic_bool ready(false);
+  std::thread server([&]()
+                     {
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(kPort), "shapingbench");
+    server.setConnectionCallback(onConnection);
+    server.setMessageCallback(onMessage);
+    server.setWriteCompleteCallback(onWriteComplete);
+    server.start();
+    serverLoop = &loop;
+    ready = true;
+    loop.loop(); });
+  while (!ready)
+  {
+    usleep(1000);
+  }
+
+  struct Scenario
+  {
+    char mode;
+    const char *name;
+    double target; // 每连接目标速率，0表示不限
+  } scenarios[] = {
+      {'d', "download unlimited", 0},
+      {'D', "download per-conn limit", g_rate},
+      {'U', "upload per-conn limit", g_rate},
+      {'T', "download tenant limit", g_rate},
+  };
+
+  printf("%d connections, limit %.0f KB/s per connection, %.1f s per scenario\n", g_numConns, g_rate / 1024, seconds);
+  double unlimitedCpuPerMB = 0;
+  for (const Scenario &s : scenarios)
+  {
+    int64_t cpuBegin = serverLoop->cpuTimeMicros();
+    std::vector<double> rates = runClients(s.mode, seconds);
+    int64_t cpuMicros = serverLoop->cpuTimeMicros() - cpuBegin;
+    usleep(200 * 1000); // 等服务端清理掉这一轮的连接
+
+    double total = 0, lo = rates[0], hi = rates[0];
+    for (double r : rates)
+    {
+      total += r;
+      lo = std::min(lo, r);
+      hi = std::max(hi, r);
+    }
+    // 预热阶段的数据也消耗cpu，按整段时间的平均速率折算
+    double cpuPerMB = cpuMicros / (total * seconds / (1024 * 1024));
+    printf("%-26s total %9.1f KB/s  per-conn min %8.1f max %8.1f KB/s", s.name, total / 1024, lo / 1024, hi / 1024);
+    if (s.target > 0)
+    {
+      printf("  error %+5.2f%%", (total / (s.target * g_numConns) - 1) * 100);
+    }
+    printf("  loop cpu %5.1f%%  %6.0f us/MB\n", cpuMicros / (seconds * 1e4), cpuPerMB);
+    if (s.target == 0)
+    {
+      unlimitedCpuPerMB = cpuPerMB;
+    }
+  }
+  printf("(unlimited baseline %.0f us/MB)\n", unlimitedCpuPerMB);
+
+  serverLoop->quit();
+  server.join();
+  return 0;
+}
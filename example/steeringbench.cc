@@ -0,0 +1,106 @@
+#include <mymuduo/TcpServer.h>
+#include <mymuduo/Logger.h>
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+// 回环上的ping-pong压测，对比开启/关闭SO_INCOMING_CPU导流时的吞吐和本地命中率
+// 用法: ./steeringbench [on|off] [连接数] [秒数]
+
+static std::atomic_bool g_stop(false);
+static std::atomic<uint64_t> g_roundTrips(0);
+
+static void clientFunc(const InetAddress &addr, int numConns, size_t msgSize)
+{
+  std::vector<int> fds;
+  for (int i = 0; i < numConns; ++i)
+  {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (::connect(fd, (const sockaddr *)addr.getSockAddr(), sizeof(sockaddr_in)) < 0)
+    {
+      perror("connect");
+      exit(1);
+    }
+    fds.push_back(fd);
+  }
+
+  std::string msg(msgSize, 'x');
+  std::vector<char> buf(msgSize);
+  while (!g_stop)
+  {
+    for (int fd : fds)
+    {
+      if (::write(fd, msg.data(), msg.size()) != static_cast<ssize_t>(msg.size()))
+      {
+        return;
+      }
+      size_t got = 0;
+      while (got < msgSize)
+      {
+        ssize_t n = ::read(fd, buf.data() + got, msgSize - got);
+        if (n <= 0)
+        {
+          return;
+        }
+        got += n;
+      }
+      g_roundTrips.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+  for (int fd : fds)
+  {
+    ::close(fd);
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  bool steering = argc <= 1 || strcmp(argv[1], "off") != 0;
+  int numConns = argc > 2 ? atoi(argv[2]) : 64;
+  int seconds = argc > 3 ? atoi(argv[3]) : 5;
+  Logger::setLogLevel(ERROR); // 每个事件一行的INFO日志会压过要测的往返开销
+
+  EventLoop loop;
+  InetAddress addr(8002);
+  TcpServer server(&loop, addr, "SteeringBench");
+  server.threadPool()->setOnePerPhysicalCore();
+  server.setCpuSteering(steering);
+  server.setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+                            { conn->send(buf->retrieveAllAsString()); });
+  server.start();
+
+  std::thread bench([&]()
+                    {
+    int numClients = static_cast<int>(server.threadPool()->getAllLoops().size());
+    std::vector<std::thread> clients;
+    for (int i = 0; i < numClients; ++i)
+    {
+      clients.emplace_back(clientFunc, addr, numConns / numClients + 1, 64);
+    }
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    g_stop = true;
+    for (auto &t : clients)
+    {
+      t.join();
+    }
+
+    TcpServer::SteeringStats stats = server.steeringStats();
+    fprintf(stderr, "steering=%s loops=%d round trips/s=%.0f local=%lu nearby=%lu fallback=%lu\n",
+            steering ? "on" : "off", numClients,
+            static_cast<double>(g_roundTrips.load()) / seconds,
+            stats.local, stats.nearby, stats.fallback);
+    loop.quit(); });
+
+  loop.loop();
+  bench.join();
+  return 0;
+}
@@ -0,0 +1,182 @@
+#include <mymuduo/TcpServer.h>
+#include <mymuduo/Logger.h>
+#include <mymuduo/Payload.h>
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+// 零拷贝发送(MSG_ZEROCOPY)和普通拷贝在不同消息大小下的对比，找交叉点
+// 客户端连上来先发5个字节：模式('c'拷贝/'z'零拷贝)和消息字节数，服务端反复发送同一个共享数据块，
+// 发送队列空了(WriteCompleteCallback)就再补几条，直到发够总量；统计服务端loop线程每GB的cpu时间和吞吐
+// 注意loopback上内核最终还是要把数据拷到接收端，零拷贝省下的只是发送端的那次拷贝，
+// 而要多付锁页和完成通知的开销，真实网卡上交叉点会更靠前
+// 用法: ./zerocopybench [每轮MB数] [消息字节数...]
+
+namespace
+{
+  const uint16_t kPort = 19700;
+  const int kInFlight = 4; // 每次补充的消息条数
+
+  int64_t g_totalBytes = 512LL * 1024 * 1024;
+
+  struct Sender
+  {
+    Payload block;
+    int64_t remaining;
+  };
+  // 只在服务端loop线程中访问
+  std::map<TcpConnection *, Sender> g_senders;
+  EventLoop *g_loop = nullptr;
+
+  // 断开的连接的计数，在loop线程写，写完置位
+  ConnectionStats g_closedStats;
+  std::atomic_bool g_closed(false);
+
+  void refill(const TcpConnectionPtr &conn)
+  {
+    auto it = g_senders.find(conn.get());
+    if (it == g_senders.end())
+    {
+      return;
+    }
+    Sender &s = it->second;
+    for (int i = 0; i < kInFlight && s.remaining > 0; ++i)
+    {
+      conn->send(s.block);
+      s.remaining -= static_cast<int64_t>(s.block.size());
+    }
+  }
+
+  void onConnection(const TcpConnectionPtr &conn)
+  {
+    if (!conn->connected())
+    {
+      g_senders.erase(conn.get());
+      g_closedStats = conn->stats();
+      g_closed = true;
+    }
+  }
+
+  void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+  {
+    if (buf->readableBytes() < 5 || g_senders.count(conn.get()) > 0)
+    {
+      return;
+    }
+    char mode = buf->peek()[0];
+    uint32_t size = 0;
+    memcpy(&size, buf->peek() + 1, sizeof size);
+    buf->retrieve(5);
+    if (mode == 'z' && !conn->enableZeroCopy(1))
+    {
+      fprintf(stderr, "SO_ZEROCOPY not supported\n");
+      exit(1);
+    }
+    Sender &s = g_senders[conn.get()];
+    s.block = Payload(std::make_shared<std::string>(size, 'z'));
+    s.remaining = g_totalBytes;
+    refill(conn);
+  }
+
+  void runRound(char mode, uint32_t size)
+  {
+    InetAddress addr(kPort);
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (::connect(fd, (const sockaddr *)addr.getSockAddr(), sizeof(sockaddr_in)) < 0)
+    {
+      perror("connect");
+      exit(1);
+    }
+    int64_t cpuBegin = g_loop->cpuTimeMicros();
+    auto begin = std::chrono::steady_clock::now();
+    char hello[5];
+    hello[0] = mode;
+    memcpy(hello + 1, &size, sizeof size);
+    ::send(fd, hello, sizeof hello, 0);
+
+    // 总量按消息大小向上取整
+    int64_t expected = (g_totalBytes + size - 1) / size * size;
+    std::vector<char> buf(1024 * 1024);
+    while (expected > 0)
+    {
+      ssize_t n = ::recv(fd, buf.data(), buf.size(), 0);
+      if (n <= 0)
+      {
+        break;
+      }
+      expected -= n;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    int64_t cpuMicros = g_loop->cpuTimeMicros() - cpuBegin;
+    g_closed = false;
+    ::close(fd);
+    while (!g_closed)
+    {
+      usleep(1000);
+    }
+
+    const double gb = g_totalBytes / (1024.0 * 1024 * 1024);
+    printf("%8u  %-9s %7.2f GB/s  server cpu %7.1f ms/GB", size, mode == 'z' ? "zerocopy" : "copy",
+           gb / seconds, cpuMicros / 1000.0 / gb);
+    if (mode == 'z')
+    {
+      // 内核没能零拷贝(loopback上总是这样)时会在完成通知里标出来
+      printf("  sends %llu, kernel copied %llu", static_cast<unsigned long long>(g_closedStats.zeroCopySends),
+             static_cast<unsigned long long>(g_closedStats.zeroCopyCopied));
+    }
+    printf("\n");
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  g_totalBytes = (argc > 1 ? atoll(argv[1]) : 512) * 1024 * 1024;
+  std::vector<uint32_t> sizes;
+  for (int i = 2; i < argc; ++i)
+  {
+    sizes.push_back(static_cast<uint32_t>(atoi(argv[i])));
+  }
+  if (sizes.empty())
+  {
+    sizes = {4096, 16384, 32768, 65536, 131072, 262144, 1048576};
+  }
+  Logger::setLogLevel(ERROR);
+
+  std::atomic_bool ready(false);
+  std::thread server([&]()
+                     {
+    EventLoop loop;
+    TcpServer s(&loop, InetAddress(kPort), "zerocopybench");
+    s.setConnectionCallback(onConnection);
+    s.setMessageCallback(onMessage);
+    s.setWriteCompleteCallback(refill);
+    s.start();
+    g_loop = &loop;
+    ready = true;
+    loop.loop(); });
+  while (!ready)
+  {
+    usleep(1000);
+  }
+
+  printf("%8s  %-9s %12s  %s\n", "msg size", "mode", "throughput", "sender cost");
+  for (uint32_t size : sizes)
+  {
+    runRound('c', size);
+    runRound('z', size);
+  }
+
+  g_loop->quit();
+  server.join();
+  return 0;
+}